@@ -0,0 +1,101 @@
+#include "BeanUsage.hpp"
+#include <algorithm>
+
+static long dayOf(long timestamp) {
+  auto day = timestamp - timestamp % BeanUsageIndex::dayLength;
+  return day > timestamp ? day - BeanUsageIndex::dayLength : day;
+}
+
+static void add(BeanUsage& usage, long amount, int sign) {
+  usage.amount += sign * amount;
+  usage.roasts += sign;
+}
+
+void BeanUsageIndex::update(long roastId, Roast const* roast) {
+  auto it = contributions.find(roastId);
+  if(it != contributions.end()) {
+    apply(it->second, -1);
+    contributions.erase(it);
+  }
+  if(roast == nullptr || roast->getIngredientsCount() == 0) {
+    return;
+  }
+
+  // A bean listed twice in one roast still counts as one roast
+  Contribution contribution{dayOf(roast->getTimestamp()), {}};
+  for(auto i = 0; i < roast->getIngredientsCount(); i++) {
+    auto const& ingredient = roast->getIngredient(i);
+    auto id = ingredient.getBeanId();
+    auto bean = std::find_if(contribution.amounts.begin(), contribution.amounts.end(),
+                             [id](auto const& entry) { return entry.first.getId() == id; });
+    if(bean == contribution.amounts.end()) {
+      contribution.amounts.emplace_back(ingredient.getBean(), ingredient.getAmount());
+    } else {
+      bean->second += ingredient.getAmount();
+    }
+  }
+  apply(contribution, 1);
+  contributions.emplace(roastId, std::move(contribution));
+}
+
+// Entries no roast counts towards any more are dropped
+void BeanUsageIndex::apply(Contribution const& contribution, int sign) {
+  for(auto const& [bean, amount] : contribution.amounts) {
+    auto id = bean.getId();
+    beans.emplace(id, bean);
+    auto& total = totals[id];
+    add(total, amount, sign);
+    auto& days = daily[id];
+    auto& day = days[contribution.day];
+    add(day, amount, sign);
+
+    if(day.roasts == 0) {
+      days.erase(contribution.day);
+    }
+    if(total.roasts == 0) {
+      totals.erase(id);
+      daily.erase(id);
+      beans.erase(id);
+    }
+  }
+}
+
+BeanUsageReport BeanUsageIndex::reportOn(BeanId bean, std::optional<long> from,
+                                         std::optional<long> to) const {
+  BeanUsageReport report{beans.at(bean).getName(), totals.at(bean), {}};
+  if(!from && !to) {
+    return report;
+  }
+
+  auto const& days = daily.at(bean);
+  auto begin = from ? days.lower_bound(*from) : days.begin();
+  auto end = to ? days.lower_bound(*to) : days.end();
+  report.total = {};
+  for(auto it = begin; it != end; ++it) {
+    report.total.amount += it->second.amount;
+    report.total.roasts += it->second.roasts;
+    report.days.emplace_back(it->first, it->second);
+  }
+  return report;
+}
+
+std::vector<BeanUsageReport> BeanUsageIndex::report(BeanCatalog const& catalog,
+                                                    std::optional<std::string> const& bean,
+                                                    std::optional<long> from,
+                                                    std::optional<long> to) const {
+  std::vector<BeanUsageReport> reports;
+  if(bean) {
+    BeanId id;
+    if(catalog.find(*bean, id) && totals.count(id) > 0) {
+      reports.push_back(reportOn(id, from, to));
+    }
+    return reports;
+  }
+
+  for(auto const& entry : totals) {
+    reports.push_back(reportOn(entry.first, from, to));
+  }
+  std::sort(reports.begin(), reports.end(),
+            [](auto const& a, auto const& b) { return a.name < b.name; });
+  return reports;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Model/RoastyModel.hpp"
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Grams of a bean roasted and the number of roasts using it
+struct BeanUsage {
+  long amount = 0;
+  size_t roasts = 0;
+};
+
+struct BeanUsageReport {
+  std::string name;
+  BeanUsage total;
+  std::vector<std::pair<long, BeanUsage>> days; // Start of the day, only for reports on a range
+};
+
+// Bean usage summed over all roasts and per day, a roast counting on the UTC day its
+// beginTimestamp falls on. Each roast's last contribution is kept, so a write to it only takes
+// that back out and adds the new one, and reports never look at the roasts themselves.
+class BeanUsageIndex {
+public:
+  static long const dayLength = 24L * 60 * 60 * 1000;
+
+  // Replaces the contribution of roastId, nullptr for a roast that was deleted
+  void update(long roastId, Roast const* roast);
+
+  // All beans, or only bean if given. With a range the totals cover the days starting in
+  // [from, to) and the report lists those days.
+  std::vector<BeanUsageReport> report(BeanCatalog const& catalog,
+                                      std::optional<std::string> const& bean,
+                                      std::optional<long> from, std::optional<long> to) const;
+
+private:
+  struct Contribution {
+    long day;
+    std::vector<std::pair<Bean, long>> amounts;
+  };
+  std::unordered_map<long, Contribution> contributions;
+  std::unordered_map<BeanId, BeanUsage> totals;
+  std::unordered_map<BeanId, std::map<long, BeanUsage>> daily;
+  std::unordered_map<BeanId, Bean> beans; // Keeps the names of the beans in totals
+
+  void apply(Contribution const& contribution, int sign);
+  BeanUsageReport reportOn(BeanId bean, std::optional<long> from, std::optional<long> to) const;
+};
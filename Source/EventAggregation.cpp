@@ -0,0 +1,37 @@
+#include "EventAggregation.hpp"
+#include <algorithm>
+
+// Start of the window holding timestamp, rounding towards negative infinity
+static long windowStart(long timestamp, long width) {
+  auto start = timestamp - timestamp % width;
+  return start > timestamp ? start - width : start;
+}
+
+std::vector<EventBucket> aggregateEvents(EventSeries const& events, long bucketWidth,
+                                         std::optional<std::string> const& type) {
+  std::vector<long> timestamps;
+  std::vector<int> values;
+  events.decodeValues(type, timestamps, values);
+
+  // Each window is a contiguous run of the value column, reduced with plain loops over an int
+  // array that the compiler vectorises
+  std::vector<EventBucket> buckets;
+  for(size_t begin = 0, end = 0; begin < timestamps.size(); begin = end) {
+    auto start = windowStart(timestamps[begin], bucketWidth);
+    end = std::upper_bound(timestamps.begin() + begin, timestamps.end(), start + bucketWidth - 1) -
+          timestamps.begin();
+
+    auto const* run = values.data() + begin;
+    auto length = end - begin;
+    auto min = run[0];
+    auto max = run[0];
+    long sum = 0;
+    for(size_t i = 0; i < length; i++) {
+      min = std::min(min, run[i]);
+      max = std::max(max, run[i]);
+      sum += run[i];
+    }
+    buckets.push_back({start, length, min, max, static_cast<double>(sum) / length});
+  }
+  return buckets;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Model/RoastyModel.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Aggregates of the event values falling into one window of a roast. Windows start at multiples
+// of their width, so the same window is reported with the same start by every query.
+struct EventBucket {
+  long start;
+  size_t count;
+  int min;
+  int max;
+  double avg;
+};
+
+// Which aggregates a response carries, parsed from a list like "min,max,avg"
+enum EventAggregate : unsigned { Count = 1 << 0, Min = 1 << 1, Max = 1 << 2, Avg = 1 << 3 };
+
+// Windows with no events are left out. Events without a value never count.
+std::vector<EventBucket> aggregateEvents(EventSeries const& events, long bucketWidth,
+                                         std::optional<std::string> const& type = std::nullopt);
@@ -2,60 +2,119 @@
 
 #include "RoastyModel.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 
 /* ============== Bean ================= */
 
-Bean::Bean(std::string inputBeanName) : 
-    beanName(inputBeanName) 
-{}
-
-Bean::Bean(Bean const& other) : 
-    beanName(other.getName()) 
-{}
+struct BeanName
+{
+    /* Only accessed through std::atomic_load/atomic_store */
+    std::shared_ptr<std::string const> value;
+};
 
-Bean& 
-Bean::operator=(Bean const& other) 
+Bean::Bean(std::string inputBeanName) : 
+    beanName(std::make_shared<BeanName>())
 {
-    // copy other's bean name 
-    this->beanName = other.getName();
-    return *this;
+    beanName->value = std::make_shared<std::string const>(std::move(inputBeanName));
 }
 
 std::string 
 Bean::getName() const
 {
-    return beanName;
+    return *std::atomic_load(&beanName->value);
+}
+
+BeanId 
+Bean::getId() const
+{
+    return beanName.get();
+}
+
+/* ============== Bean Catalog ================= */
+
+Bean 
+BeanCatalog::intern(Bean const& bean)
+{
+    auto name = bean.getName();
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto& known = names[name];
+    if (auto shared = known.lock())
+    {
+        Bean interned{bean};
+        interned.beanName = std::move(shared);
+        return interned;
+    }
+
+    // First bean with this name, or the last one using it is gone
+    known = bean.beanName;
+    if (names.size() >= sweepSize)
+    {
+        for (auto it = names.begin(); it != names.end();)
+        {
+            it = it->second.expired() ? names.erase(it) : std::next(it);
+        }
+        sweepSize = std::max<std::size_t>(64, names.size() * 2);
+    }
+    return bean;
+}
+
+bool 
+BeanCatalog::find(std::string const& beanName, BeanId& beanId) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = names.find(beanName);
+    if (it == names.end())
+    {
+        return false;
+    }
+    auto shared = it->second.lock();
+    if (!shared)
+    {
+        return false;
+    }
+    beanId = shared.get();
+    return true;
+}
+
+void 
+BeanCatalog::rename(Bean const& bean, std::string const& newName)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = names.find(bean.getName());
+    if (it != names.end() && it->second.lock() == bean.beanName)
+    {
+        names.erase(it);
+    }
+    names[newName] = bean.beanName;
+    std::atomic_store(&bean.beanName->value, std::make_shared<std::string const>(newName));
 }
 
 /* ============== Ingredients ================ */
 
-Ingredient::Ingredient(Bean& inputBean, int inputAmount) : 
-    bean(inputBean), 
-    amount(inputAmount) 
+Ingredient::Ingredient(Bean const& inputBean, int inputAmount) : 
+    amount(inputAmount),
+    bean(inputBean) 
 {}
 
 Ingredient::Ingredient(Ingredient const& other) : 
-    bean(*(new Bean(other.getBean()))), 
-    amount(other.getAmount()) 
+    amount(other.getAmount()),
+    bean(other.bean) 
 {}
 
 Ingredient& 
 Ingredient::operator=(Ingredient const& other)
 {
-    // Check if this and other are the identical
-    if (this == &other)
-    {
-        return *this;
-    }
-
-    // Delete the existing Bean object 
-    delete &this->bean;
-
     // Assign new data 
-    this->bean = *(new Bean(other.getBean()));
     this->amount = other.getAmount();
+    this->bean = other.bean;
 
     return *this;
 }
@@ -66,15 +125,16 @@ Ingredient::getAmount() const
     return amount;
 }
 
-Bean const& 
+Bean 
 Ingredient::getBean() const
 {
     return bean;
 }
 
-Ingredient::~Ingredient()
+BeanId 
+Ingredient::getBeanId() const
 {
-    delete &bean;
+    return bean.getId();
 }
 
 /* ============== Event Value ================ */
@@ -104,174 +164,482 @@ EventValue::getValue() const
 /* ============== Event ================ */
 
 Event::Event(std::string inputType, long inputTimestamp, EventValue* inputEventValue) :
-    type(inputType),
     timestamp(inputTimestamp),
-    eventValue(inputEventValue) 
+    type(std::move(inputType))
+{
+    // Copy the value inline and release the passed object 
+    if (inputEventValue != nullptr)
+    {
+        eventValue = *inputEventValue;
+        delete inputEventValue;
+    }
+}
+
+Event::Event(std::string inputType, long inputTimestamp, int inputValue) :
+    timestamp(inputTimestamp),
+    type(std::move(inputType)),
+    eventValue(EventValue{inputValue})
 {}
 
-Event::Event(Event const& other)
+bool 
+Event::hasValue()const
+{
+    return eventValue.has_value();
+}
+
+long 
+Event::getTimestamp() const 
+{
+    return timestamp;
+}
+
+EventValue const* 
+Event::getValue() const
+{
+    if (!eventValue)
+    {
+        return nullptr;
+    }
+    return &*eventValue;
+}
+
+std::string 
+Event::getType() const
 {
-    // Assign other's data to this object 
-    dataTransfer(other);
+    return type;
 }
 
-Event& 
-Event::operator=(Event const& other)
+/* ============== Event Series ================ */
+
+namespace
 {
-    //Check if this and other are the identical 
-    if (this == &other)
+
+void 
+writeVarint(EventSeries::Column& column, std::uint64_t value)
+{
+    while (value >= 0x80)
     {
-        return *this;
+        column.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
     }
+    column.push_back(static_cast<std::uint8_t>(value));
+}
 
-    // Delete the existing EventValue object
-    if (other.hasValue())
+/* Returns false instead of reading past the end of column */
+bool 
+readVarint(EventSeries::Column const& column, std::size_t& offset, std::uint64_t& value)
+{
+    value = 0;
+    for (auto shift = 0; shift < 64 && offset < column.size(); shift += 7)
     {
-        delete other.getValue();
+        auto byte = column[offset++];
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80)
+        {
+            return true;
+        }
     }
+    return false;
+}
 
-    // Copy over other's data to this object 
-    dataTransfer(other); 
+/* Zigzag encoding keeps small negative deltas small */
+std::uint64_t 
+zigzag(std::uint64_t delta)
+{
+    return (delta << 1) ^ (0 - (delta >> 63));
+}
 
-    return *this;
+std::uint64_t 
+unzigzag(std::uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
 }
 
-void 
-Event::dataTransfer(Event const& other)
+}
+
+class EventSeries::Cursor
 {
-    // Copy timestamp, type and eventValue
+public:
 
-    this->timestamp = other.getTimestamp();
-    this->type = other.getType();
+    /* Positioned at the first event of the block holding number */
+    Cursor(EventSeries const& inputSeries, std::size_t number) :
+        series(inputSeries),
+        position(number - number % BLOCK_SIZE)
+    {
+        if (position < series.count)
+        {
+            auto const& block = series.blocks[position / BLOCK_SIZE];
+            timestampOffset = block.timestamp;
+            codeOffset = block.code;
+            valueOffset = block.value;
+        }
+    }
 
-    if (other.hasValue())
+    /* Bool check if another event could be decoded and
+    decodes it if so, false if the columns are malformed */
+    bool next()
     {
-        this->eventValue = new EventValue(*other.getValue());
+        if (position % BLOCK_SIZE == 0)
+        {
+            timestamp = 0;
+            value = 0;
+        }
+
+        std::uint64_t delta, code;
+        if (!readVarint(series.timestamps, timestampOffset, delta) ||
+            !readVarint(series.codes, codeOffset, code) ||
+            code >> 1 >= series.types.size())
+        {
+            return false;
+        }
+        timestamp = static_cast<long>(static_cast<std::uint64_t>(timestamp) + unzigzag(delta));
+        type = code >> 1;
+        hasValue = (code & 1) != 0;
+
+        if (hasValue)
+        {
+            if (!readVarint(series.values, valueOffset, delta))
+            {
+                return false;
+            }
+            value = static_cast<int>(static_cast<std::uint64_t>(value) + unzigzag(delta));
+        }
+        position++;
+        return true;
     }
-    else
+
+    /* Skip events up to, not including, number. Stops
+    early and returns false if the columns are malformed */
+    bool skipTo(std::size_t number)
     {
-        eventValue = nullptr;
+        while (position < number)
+        {
+            if (!next())
+            {
+                return false;
+            }
+        }
+        return true;
     }
-}
 
-bool 
-Event::hasValue()const
-{
-    if (eventValue == nullptr)
+    Event event() const
     {
-        return false;
+        auto const& name = series.types[type];
+        return hasValue ? Event{name, timestamp, value} : Event{name, timestamp};
     }
-    return true;
-}
 
-long 
-Event::getTimestamp() const 
+    EventSeries const& series;
+    std::size_t position;
+    std::size_t timestampOffset = 0;
+    std::size_t codeOffset = 0;
+    std::size_t valueOffset = 0;
+    long timestamp = 0;
+    std::uint64_t type = 0;
+    bool hasValue = false;
+    int value = 0;
+};
+
+std::optional<EventSeries> 
+EventSeries::fromColumns(std::size_t eventCount, std::vector<std::string> types,
+    Column timestamps, Column codes, Column values)
 {
-    return timestamp;
+    EventSeries series;
+    series.types = std::move(types);
+    series.timestamps = std::move(timestamps);
+    series.codes = std::move(codes);
+    series.values = std::move(values);
+
+    /* Walk every event once to find the blocks and check the columns are well formed */
+    Cursor cursor{series, series.count};
+    for (auto i = std::size_t{0}; i < eventCount; i++)
+    {
+        if (i % BLOCK_SIZE == 0)
+        {
+            series.blocks.push_back(Block{static_cast<std::uint32_t>(cursor.timestampOffset),
+                static_cast<std::uint32_t>(cursor.codeOffset),
+                static_cast<std::uint32_t>(cursor.valueOffset), 0, 0});
+        }
+        if (!cursor.next())
+        {
+            return std::nullopt;
+        }
+
+        auto& block = series.blocks.back();
+        if (i % BLOCK_SIZE == 0)
+        {
+            block.earliest = block.latest = cursor.timestamp;
+        }
+        block.earliest = std::min(block.earliest, cursor.timestamp);
+        block.latest = std::max(block.latest, cursor.timestamp);
+    }
+    if (cursor.timestampOffset != series.timestamps.size() ||
+        cursor.codeOffset != series.codes.size() || cursor.valueOffset != series.values.size())
+    {
+        return std::nullopt;
+    }
+
+    series.count = eventCount;
+    series.lastTimestamp = cursor.timestamp;
+    series.lastValue = cursor.value;
+    return series;
 }
 
-EventValue* 
-Event::getValue() const
+std::size_t 
+EventSeries::size() const
 {
-    return eventValue;
+    return count;
 }
 
-std::string 
-Event::getType() const
+std::uint64_t 
+EventSeries::typeCode(std::string const& type)
 {
-    return type;
+    // A roast only sees a handful of different types
+    for (auto i = std::size_t{0}; i < types.size(); i++)
+    {
+        if (types[i] == type)
+        {
+            return i;
+        }
+    }
+    types.push_back(type);
+    return types.size() - 1;
 }
 
-Event::~Event()
+void 
+EventSeries::append(Event const& event)
 {
-    delete eventValue;
-}
+    auto timestamp = event.getTimestamp();
+    if (count % BLOCK_SIZE == 0)
+    {
+        blocks.push_back(Block{static_cast<std::uint32_t>(timestamps.size()),
+            static_cast<std::uint32_t>(codes.size()), static_cast<std::uint32_t>(values.size()),
+            timestamp, timestamp});
+        lastTimestamp = 0;
+        lastValue = 0;
+    }
+    auto& block = blocks.back();
+    block.earliest = std::min(block.earliest, timestamp);
+    block.latest = std::max(block.latest, timestamp);
 
-/* ============== Roasts ================ */
+    writeVarint(timestamps, zigzag(static_cast<std::uint64_t>(timestamp) -
+                                   static_cast<std::uint64_t>(lastTimestamp)));
+    lastTimestamp = timestamp;
 
-Roast::Roast(long inputId, long inputBeginTimestamp) :
+    writeVarint(codes, typeCode(event.getType()) << 1 | (event.hasValue() ? 1 : 0));
 
-    roastId(inputId), 
-    beginTimestamp(inputBeginTimestamp)
-    
-{   
-    // Assign initial values and create heap allocated arrays 
-    eventCount = 0;
-    ingredientsCount = 0;
-    eventArrayCapacity = INITIAL_ARRAY_SIZE;
-    ingredientArrayCapacity = INITIAL_ARRAY_SIZE;
-    eventArray = new const Event*[eventArrayCapacity];
-    ingredientArray = new const Ingredient*[ingredientArrayCapacity];
+    if (event.hasValue())
+    {
+        auto value = event.getValue()->getValue();
+        writeVarint(values, zigzag(static_cast<std::uint64_t>(
+                                static_cast<std::int64_t>(value) - lastValue)));
+        lastValue = value;
+    }
+    count++;
 }
 
-Roast::Roast(Roast const& other)
+Event 
+EventSeries::get(std::size_t number) const
 {
-    // Assign initial values and create heap allocated arrays 
-    // to prepare for creating a copy of "other"
-    this->eventArrayCapacity = INITIAL_ARRAY_SIZE;
-    this->ingredientArrayCapacity = INITIAL_ARRAY_SIZE;
-    this->eventArray = new const Event*[eventArrayCapacity];
-    this->ingredientArray = new const Ingredient*[ingredientArrayCapacity];
+    if (number >= count)
+    {
+        throw std::out_of_range("No event with that number in the series");
+    }
+    Cursor cursor{*this, number};
+    if (!cursor.skipTo(number + 1))
+    {
+        throw std::out_of_range("Event series columns end before the event");
+    }
+    return cursor.event();
+}
 
-    // Assign other's data to this object 
-    dataTransfer(other);
+std::vector<Event> 
+EventSeries::decode() const
+{
+    std::vector<Event> events;
+    events.reserve(count);
+    Cursor cursor{*this, 0};
+    while (cursor.position < count)
+    {
+        cursor.next();
+        events.push_back(cursor.event());
+    }
+    return events;
 }
 
-Roast& 
-Roast::operator=(Roast const& other)
+void 
+EventSeries::decodeValues(std::optional<std::string> const& type, 
+    std::vector<long>& eventTimestamps, std::vector<int>& eventValues) const
 {
-    // Check if this and other are the identical 
-    if (this == &other)
+    auto wanted = types.size();
+    if (type)
     {
-        return *this;
+        wanted = std::find(types.begin(), types.end(), *type) - types.begin();
+        if (wanted == types.size())
+        {
+            return;
+        }
     }
 
-    // Delete the existing objects in the existing event array
-    for (auto i=0; i<(this->eventCount); i++)
+    // Only the columns are read, no event objects are built
+    Cursor cursor{*this, 0};
+    while (cursor.position < count)
     {
-        delete this->eventArray[i];
+        cursor.next();
+        if (cursor.hasValue && (!type || cursor.type == wanted))
+        {
+            eventTimestamps.push_back(cursor.timestamp);
+            eventValues.push_back(cursor.value);
+        }
     }
 
-    // Delete the existing objects in the existing ingredient array
-    for (auto i=0; i<(this->ingredientsCount); i++)
+    // Telemetry is recorded in time order, anything else is sorted here
+    if (std::is_sorted(eventTimestamps.begin(), eventTimestamps.end()))
+    {
+        return;
+    }
+    std::vector<std::size_t> order(eventTimestamps.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+    {
+        return eventTimestamps[a] < eventTimestamps[b];
+    });
+    std::vector<long> sortedTimestamps(order.size());
+    std::vector<int> sortedValues(order.size());
+    for (auto i = std::size_t{0}; i < order.size(); i++)
     {
-        delete this->ingredientArray[i];
+        sortedTimestamps[i] = eventTimestamps[order[i]];
+        sortedValues[i] = eventValues[order[i]];
     }
+    eventTimestamps.swap(sortedTimestamps);
+    eventValues.swap(sortedValues);
+}
 
-    // Copy over other's data to this object 
-    dataTransfer(other);
+std::optional<long> 
+EventSeries::earliestTimestamp(std::string const& type) const
+{
+    std::optional<long> earliest;
+    std::uint64_t wanted = std::find(types.begin(), types.end(), type) - types.begin();
+    if (wanted == types.size())
+    {
+        return earliest;
+    }
 
-    return *this;
+    Cursor cursor{*this, 0};
+    while (cursor.position < count)
+    {
+        cursor.next();
+        if (cursor.type == wanted && (!earliest || cursor.timestamp < *earliest))
+        {
+            earliest = cursor.timestamp;
+        }
+    }
+    return earliest;
 }
 
-void 
-Roast::dataTransfer(Roast const& other)
+std::optional<std::size_t> 
+EventSeries::find(long eventTimestamp) const
 {
-    // copy roastId and beginTimestamp
-    this->roastId = other.getId(); 
-    this->beginTimestamp = other.getTimestamp();
+    for (auto b = std::size_t{0}; b < blocks.size(); b++)
+    {
+        auto const& block = blocks[b];
+        if (eventTimestamp < block.earliest || eventTimestamp > block.latest)
+        {
+            continue;
+        }
 
-    // Set/reset the counters to 0
-    this->eventCount = 0;
-    this->ingredientsCount = 0;
+        // Only the timestamp column of the block is read
+        auto offset = std::size_t{block.timestamp};
+        long timestamp = 0;
+        auto end = std::min(count, (b + 1) * BLOCK_SIZE);
+        for (auto number = b * BLOCK_SIZE; number < end; number++)
+        {
+            std::uint64_t delta;
+            readVarint(timestamps, offset, delta);
+            timestamp = static_cast<long>(static_cast<std::uint64_t>(timestamp) + unzigzag(delta));
+            if (timestamp == eventTimestamp)
+            {
+                return number;
+            }
+        }
+    }
+    return std::nullopt;
+}
 
-    // Copy eventArray elements one by one
-    for (auto i=0; i<(other.getEventCount()); i++)
+bool 
+EventSeries::remove(long eventTimestamp)
+{
+    auto removed = find(eventTimestamp);
+    if (!removed)
     {
-        // addEvent() will add the pointer to the newly created  
-        // object to eventArray and increment eventCount by one
-        this->addEvent(*(new Event(other.getEvent(i))));
+        return false;
+    }
+
+    // The deltas after the event in its block change and every later event moves up, so the
+    // series is encoded afresh from the start of that block
+    auto start = *removed - *removed % BLOCK_SIZE;
+    std::vector<Event> later;
+    later.reserve(count - start - 1);
+    Cursor cursor{*this, start};
+    while (cursor.position < count)
+    {
+        auto number = cursor.position;
+        cursor.next();
+        if (number != *removed)
+        {
+            later.push_back(cursor.event());
+        }
     }
 
-    // Copy ingredientArray elements one by one
-    for (auto i=0; i<(other.getIngredientsCount()); i++)
+    auto const block = blocks[start / BLOCK_SIZE];
+    timestamps.resize(block.timestamp);
+    codes.resize(block.code);
+    values.resize(block.value);
+    blocks.resize(start / BLOCK_SIZE);
+    count = start;
+    for (auto const& event : later)
     {
-        // addIngredient() will add the pointers to the newly created 
-        // object to ingredientArray and increment ingredientCount by one
-        this->addIngredient(*(new Ingredient(other.getIngredient(i))));
+        append(event);
     }
+    return true;
+}
+
+std::vector<std::string> const& 
+EventSeries::getTypes() const
+{
+    return types;
+}
+
+EventSeries::Column const& 
+EventSeries::getTimestamps() const
+{
+    return timestamps;
+}
+
+EventSeries::Column const& 
+EventSeries::getCodes() const
+{
+    return codes;
 }
 
+EventSeries::Column const& 
+EventSeries::getValues() const
+{
+    return values;
+}
+
+/* ============== Roasts ================ */
+
+Roast::Roast(long inputId, long inputBeginTimestamp) :
+    roastId(inputId), 
+    beginTimestamp(inputBeginTimestamp)
+{}
+
+Roast::Roast(long inputId, long inputBeginTimestamp, EventSeries inputEvents) :
+    roastId(inputId), 
+    beginTimestamp(inputBeginTimestamp),
+    events(std::move(inputEvents))
+{}
+
 long 
 Roast::getId() const
 {
@@ -287,178 +655,87 @@ Roast::getTimestamp() const
 int 
 Roast::getEventCount() const
 {
-    return eventCount;
+    return events.size();
 }
 
 int 
 Roast::getIngredientsCount() const 
 {
-    return ingredientsCount;
+    return ingredientArray.size();
 }
 
 void 
 Roast::addEvent(const Event& event) 
 {
-    // Check the identical event does not exit already 
-    for (int ptr=0; ptr<eventCount; ptr++)
-    {
-        if (eventArray[ptr] == &event)
-        {
-            // Identical event object exits already 
-            return;
-        }
-    }
-    
-    // Hit the cap limit - double the size of array and transfer data 
-    const Event* * temp;
-    if (eventCount >= eventArrayCapacity)
-    {
-        temp = new const Event*[2*eventArrayCapacity];
-
-        for (int i=0; i<eventArrayCapacity; i++)
-        {
-            temp[i] = eventArray[i];
-        }
-
-        delete[] eventArray;
-        
-        eventArrayCapacity *= 2;
-        eventArray = temp;
-        temp = nullptr;
-    }
-
-    // Add a pointer to event to the array and increment the counter
-    eventArray[eventCount] = &event; 
-    eventCount++;
-    return;
+    events.append(event);
 }
 
 void 
 Roast::addIngredient(const Ingredient& ingredient)
 {
-    // Check the identical event does not exit already 
-    for (int ptr=0; ptr<ingredientsCount; ptr++)
-    {
-        if (ingredientArray[ptr] == &ingredient)
-        {
-            // Identical event object exits already 
-            return;
-        }
-    }
-
-    // Hit the cap limit - double the size of array and transfer data 
-    const Ingredient* * temp;
-    if (ingredientsCount >= ingredientArrayCapacity)
-    {
-        temp = new const Ingredient*[2*ingredientArrayCapacity];
-
-        for (int i=0; i<ingredientArrayCapacity; i++)
-        {
-            temp[i] = ingredientArray[i];
-        }
-
-        delete[] ingredientArray;
-
-        ingredientArrayCapacity *= 2;
-        ingredientArray = temp;
-        temp = nullptr;
-    }
-
-    // Add a pointer to ingredient to the array and increment the counter
-    ingredientArray[ingredientsCount] = &ingredient; 
-    ingredientsCount++;
-    return;
+    ingredientArray.push_back(ingredient);
 }
 
 void 
 Roast::removeEventByTimestamp(long eventTimestamp)
 {
-    for (auto i=0; i<eventCount; i++)
-    {
-        if ((eventArray[i] != nullptr) && (eventArray[i]->getTimestamp() == eventTimestamp))
-        {
-            /* 
-            TASK - Remove this event and replace it with last event in the array
-            SOFT ASSUMPTION - There wont be too many elements 
-            in the array to cause too much computational inefficiency 
-            ALTERNATIVE SOLUTION - Take the last element and replace 
-            the removed element and decrement the counter by one 
-            */
-
-            delete eventArray[i];
-            eventCount--;
-
-            for (int j=i; j<eventCount; j++)
-            {
-                // Shift each element one by one 
-                eventArray[j] = eventArray[j+1];
-
-                // Set the duplicated pointer at the end of the array to 0 
-                eventArray[j+1] = nullptr;
-            }
-            break;
-        } 
-    }
-    return;
+    events.remove(eventTimestamp);
 }
 
 void 
 Roast::removeIngredientByBeanName(std::string beanName)
 {
-    for (auto i=0; i<ingredientsCount; i++)
+    for (auto it = ingredientArray.begin(); it != ingredientArray.end(); it++)
     {
-        if ((ingredientArray[i] != nullptr) && (ingredientArray[i]->getBean().getName() == beanName))
+        if (it->getBean().getName() == beanName)
         {
-            /* 
-            TASK - Remove this ingredient and replace it with last event in the array
-            SOFT ASSUMPTION - There wont be too many elements 
-            in the array to cause too much computational inefficiency 
-            ALTERNATIVE SOLUTION - Take the last element and replace 
-            the removed element and decrement the counter by one 
-            */
-
-            delete ingredientArray[i]; 
-            ingredientsCount--;
-
-            for (int j=i; j<ingredientsCount; j++)
-            {
-                // Shift each element one by one 
-                ingredientArray[j] = ingredientArray[j+1];
-
-                // Set the duplicated pointer at the end of the array to 0 
-                ingredientArray[j+1] = nullptr;
-            }
+            ingredientArray.erase(it);
+            break;
         } 
-        break;
     }
     return;
 }
 
-Event const& 
+Event 
 Roast::getEvent(int number) const
 {
-    return *eventArray[number];
+    return events.get(number);
 }
 
-Ingredient const& 
-Roast::getIngredient(int number) const
+std::vector<Event> 
+Roast::getEvents() const
 {
-    return *ingredientArray[number];
+    return events.decode();
 }
 
-Roast::~Roast()
+std::optional<Event> 
+Roast::findEvent(long eventTimestamp) const
 {
-    // Delete all heap allocated events and the array 
-    for (int i=0; i<eventCount; i++)
+    auto number = events.find(eventTimestamp);
+    if (!number)
     {
-        delete eventArray[i];
+        return std::nullopt;
     }
-    delete[] eventArray;
+    return events.get(*number);
+}
+
+EventSeries const& 
+Roast::getEventSeries() const
+{
+    return events;
+}
+
+Ingredient const& 
+Roast::getIngredient(int number) const
+{
+    return ingredientArray[number];
+}
 
-    // Delete all heap allocated ingredients and the array 
-    for (int i=0; i<ingredientsCount; i++)
+void 
+Roast::internBeans(BeanCatalog& catalog)
+{
+    for (auto& ingredient : ingredientArray)
     {
-        delete ingredientArray[i];
+        ingredient = Ingredient{catalog.intern(ingredient.getBean()), ingredient.getAmount()};
     }
-    delete[] ingredientArray;
 }
@@ -2,46 +2,103 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
 #include <string>
-
-/* Initial array size of 6 is assumed since there are six
-events that could take place in any roasting proccess */
-#define INITIAL_ARRAY_SIZE 6
+#include <unordered_map>
+#include <vector>
 
 /*******************************************************
-                          Bean  
+                          Bean
+ * Bean object is a handle to a shared name. A bean made
+ * from a name holds a name of its own until a storage's
+ * BeanCatalog interns it, from then on it shares the one
+ * name the catalog keeps for every bean and ingredient
+ * of that name, so renaming it renames them all. The
+ * name is read by request threads while a writer may
+ * rename it, so it is swapped atomically
 ********************************************************/
 
+struct BeanName;
+
+/* Identity of a bean's shared name, equal for beans
+interned by the same catalog under the same name. The
+name is shared rather than numbered because catalogs
+belong to a storage: a number would need a pointer to
+its catalog next to it to be read */
+typedef BeanName const* BeanId;
+
 class Bean 
 {
 public:
 
     Bean(std::string inputBeanName);
 
-    Bean(Bean const& other); 
+    Bean(Bean const& other) = default; 
 
-    Bean& operator=(Bean const& other); 
+    Bean& operator=(Bean const& other) = default; 
 
     /* Getter function for beanName */
     std::string getName() const; 
 
-    ~Bean(){} 
+    /* Getter function for beanId */
+    BeanId getId() const;
+
+    ~Bean() = default; 
+
+private:
+
+    friend class BeanCatalog;
+
+    std::shared_ptr<BeanName> beanName; 
+};
+
+/*******************************************************
+                       BeanCatalog
+ * Table owned by a storage holding one shared name per
+ * bean name the storage keeps. Names nothing refers to
+ * any more are dropped. Lookups never add a name, only
+ * beans and roasts the storage keeps are interned
+********************************************************/
+
+class BeanCatalog
+{
+public:
+
+    /* Return the catalog's bean with the name of bean, 
+    making bean's name the catalog's if it has none yet */
+    Bean intern(Bean const& bean);
+
+    /* Bool check if beanName is interned and returns true
+    and stores its id in beanId if it is, false otherwise */
+    bool find(std::string const& beanName, BeanId& beanId) const;
+
+    /* Give bean newName, which every bean and ingredient
+    sharing its name reports from then on. newName must 
+    not be interned already, as the two names would stay
+    apart */
+    void rename(Bean const& bean, std::string const& newName);
 
 private:
 
-    std::string beanName; 
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<BeanName>> names;
+    std::size_t sweepSize = 64; // Expired names are dropped when the table reaches this size
 };
 
 /*******************************************************
                        Ingredient 
- * Ingredient object has the ownership of bean object
+ * Ingredient object shares the name of its bean
 ********************************************************/
 
 class Ingredient 
 {
 public:
 
-    Ingredient(Bean& inputBean, int inputNewAmount); 
+    Ingredient(Bean const& inputBean, int inputNewAmount); 
 
     Ingredient(Ingredient const& other); 
 
@@ -51,17 +108,17 @@ public:
     int getAmount() const; 
 
     /* Getter function for bean object */
-    Bean const& getBean() const;
+    Bean getBean() const;
+
+    /* Getter function for beanId */
+    BeanId getBeanId() const;
 
-    /* Destructor that deletes all owned objects
-    i.e. Bean object */ 
-    ~Ingredient();
+    ~Ingredient(){}
 
 private:
 
     int amount; 
-    Bean& bean; // Owned by Ingredient object
-     
+    Bean bean;
 };
 
 /*******************************************************
@@ -90,22 +147,26 @@ private:
 
 /*******************************************************
                          Event
- * Event object has the ownership of EventValue object 
+ * Event object holds its EventValue inline
 ********************************************************/
 
 class Event 
 {
 public:
 
+    /* Takes the ownership of inputEventValue, whose 
+    value is copied inline and the object deleted */
     Event(std::string inputType, long inputTimestamp, EventValue* inputEventValue = nullptr); 
 
-    Event(Event const& other); 
+    Event(std::string inputType, long inputTimestamp, int inputValue); 
+
+    Event(Event const& other) = default; 
 
-    Event& operator=(Event const& other);
+    Event(Event&& other) noexcept = default; 
 
-    /* Utility function to transfer *all* class member
-     data from existing event to new/existing event */
-    void dataTransfer(Event const& other);
+    Event& operator=(Event const& other) = default;
+
+    Event& operator=(Event&& other) noexcept = default;
 
     /* Bool check if object has eventValue and
     returns true if it does and false otherwise */
@@ -114,27 +175,125 @@ public:
     /* Getter function for timestamp */
     long getTimestamp() const; 
 
-    /* Getter function for eventValue object */
-    EventValue* getValue() const; 
+    /* Getter function for eventValue object, 
+    returns nullptr if the event has no value */
+    EventValue const* getValue() const; 
 
     /* Getter function for type */
     std::string getType() const; 
-    
-    /* Destructor that deletes all owned objects
-    i.e. EventValue object */  
-    ~Event(); 
+
+    ~Event() = default; 
 
 private:
 
     long timestamp; 
     std::string type; 
-    EventValue* eventValue; // Owned by Ingredient object
+    std::optional<EventValue> eventValue;
+};
+
+/*******************************************************
+                      EventSeries
+ * Events of a roast stored as three columns of varints:
+ * timestamps and values as zigzag encoded deltas from
+ * the previous event, and types as codes into the
+ * roast's own table of type names, with the lowest bit
+ * of a code telling if the event has a value. Events
+ * keep the order they were added in. Every BLOCK_SIZE
+ * events a block starts whose deltas are taken from
+ * zero, so one event is decoded from its block alone,
+ * and blocks whose timestamps cannot match a lookup
+ * are skipped without decoding them
+********************************************************/
+
+class EventSeries
+{
+public:
+
+    static std::size_t const BLOCK_SIZE = 32;
+
+    typedef std::vector<std::uint8_t> Column;
+
+    EventSeries() = default;
+
+    /* Rebuild a series from the columns returned by the
+    getters below, returns nullopt if they do not hold
+    exactly eventCount well formed events */
+    static std::optional<EventSeries> fromColumns(std::size_t eventCount,
+        std::vector<std::string> types, Column timestamps, Column codes, Column values);
+
+    /* Getter function for the number of events */
+    std::size_t size() const;
+
+    /* Encode the passed event after the last one */
+    void append(Event const& event);
+
+    /* Decode a specified event, throws std::out_of_range
+    if there is no such event */
+    Event get(std::size_t number) const;
+
+    /* Decode all events in order */
+    std::vector<Event> decode() const;
+
+    /* Getter function for the number of the first event
+    with eventTimestamp, returns nullopt if there is none.
+    Only the timestamps are decoded */
+    std::optional<std::size_t> find(long eventTimestamp) const;
+
+    /* Decode the timestamps and values of the events with 
+    a value, only those of type if one is given, in order 
+    of timestamp */
+    void decodeValues(std::optional<std::string> const& type, 
+        std::vector<long>& eventTimestamps, std::vector<int>& eventValues) const;
+
+    /* Getter function for the earliest timestamp of an 
+    event of type, returns nullopt if there is none */
+    std::optional<long> earliestTimestamp(std::string const& type) const;
+
+    /* Remove the first event with eventTimestamp, keeping
+    the order of the remaining events. Returns false if
+    there is no such event */
+    bool remove(long eventTimestamp);
+
+    /* Getter functions for the columns */
+    std::vector<std::string> const& getTypes() const;
+    Column const& getTimestamps() const;
+    Column const& getCodes() const;
+    Column const& getValues() const;
+
+private:
+
+    /* Column offsets where a block starts and the range
+    of the timestamps in it */
+    struct Block
+    {
+        std::uint32_t timestamp;
+        std::uint32_t code;
+        std::uint32_t value;
+        long earliest;
+        long latest;
+    };
+
+    /* Decodes events one after the other from the start of a block */
+    class Cursor;
+
+    std::size_t count = 0;
+    std::vector<std::string> types;
+    Column timestamps;
+    Column codes;
+    Column values;
+    std::vector<Block> blocks;
+
+    /* State the next appended event is encoded against */
+    long lastTimestamp = 0;
+    int lastValue = 0;
+
+    std::uint64_t typeCode(std::string const& type);
 };
 
 /*******************************************************
                          Roast
- * Roast object has the ownership ot Event objects 
- * Roast object has the ownership of Ingredient objects 
+ * Roast object holds its Ingredient objects by value in
+ * a contiguous array and its events as an EventSeries
 ********************************************************/
 
 class Roast 
@@ -143,15 +302,15 @@ public:
 
     Roast(long inputId, long inputBeginTimestamp); 
 
-    Roast(Roast const& other); 
+    Roast(long inputId, long inputBeginTimestamp, EventSeries inputEvents); 
+
+    Roast(Roast const& other) = default; 
 
-    Roast& operator=(Roast const& other);
+    Roast(Roast&& other) noexcept = default; 
 
-    /* Utility function to transfer *some* class member
-    data from existing roast to new/existing roast i.e. 
-    roastId, beginTimestamp, eventCount, ingredientCount,
-    eventArray and ingredientArray */
-    void dataTransfer(Roast const& other); 
+    Roast& operator=(Roast const& other) = default;
+
+    Roast& operator=(Roast&& other) noexcept = default;
 
     /* Getter function for roastId */
     long getId() const; 
@@ -165,49 +324,49 @@ public:
     /* Getter function for ingredientCount */
     int getIngredientsCount() const;
 
-    /* Take the owneship of the passed event object
-    & take a pointer to it and add it to eventArray */
+    /* Encode the passed event object after the last event */
     void addEvent(const Event& event); 
 
-    /* Take the owneship of the passed ingredient object
-    & take a pointer to it and add it to ingredientArray */
+    /* Copy the passed ingredient object to the end of ingredientArray */
     void addIngredient(const Ingredient& ingredient);
 
-    /* Destroy the target event object and take its pointer
-    off of eventArray & decrement eventCount by one */
+    /* Remove the target event object from the events, 
+    keeping the order of the remaining events */
     void removeEventByTimestamp(long eventTimestamp); 
 
-    /* Destroy the target ingredient object and take its pointer
-    off of eventArray & decrement eventCount by one */
+    /* Remove the target ingredient object from ingredientArray, 
+    keeping the order of the remaining ingredients */
     void removeIngredientByBeanName(std::string beanName); 
 
-    /* Getter function for a specified event object in eventArray */
-    Event const& getEvent(int number) const; 
+    /* Getter function for a specified event object, 
+    decoded from the events. Throws std::out_of_range 
+    if there is no such event */
+    Event getEvent(int number) const; 
+
+    /* Getter function for all event objects in order */
+    std::vector<Event> getEvents() const;
+
+    /* Getter function for the event with eventTimestamp, 
+    returns nullopt if there is none */
+    std::optional<Event> findEvent(long eventTimestamp) const;
+
+    /* Getter function for the encoded events */
+    EventSeries const& getEventSeries() const;
 
     /* Getter function for a specified ingredient object in ingredeintArray */
     Ingredient const& getIngredient(int number) const; 
 
-    /* Destructor that deletes all owned objects
-    i.e. Event and Ingredient objects */ 
-    ~Roast();
+    /* Replace the bean of every ingredient by the one
+    catalog keeps under its name */
+    void internBeans(BeanCatalog& catalog);
+
+    ~Roast() = default;
 
 private:
 
     long roastId; 
     long beginTimestamp; 
-    int eventCount;
-    int ingredientsCount;
-    int eventArrayCapacity;
-    int ingredientArrayCapacity;
-
-    /* Heap allocated array containing pointers to heap allocated Event objects */
-    const Event* * eventArray; // Owned by Roast object
-
-    /* Heap allocated array containing pointers to heap allocated Ingredient objects */
-    const Ingredient* * ingredientArray; // Owned by Roast object
-    
-    /* DEAR MARKER
-    Ideally, I would implment the above resizable arrays by writing my own templated class
-    (or just using std::vector) but since we are not allowed to use templates at all 
-    I incooperated the "resizability" into addIngredient() and addEvent(). */
+
+    EventSeries events;
+    std::vector<Ingredient> ingredientArray;
 };
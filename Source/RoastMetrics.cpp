@@ -0,0 +1,69 @@
+#include "RoastMetrics.hpp"
+#include <algorithm>
+#include <numeric>
+
+static std::optional<long> durationBetween(std::optional<long> from, std::optional<long> to) {
+  if(!from || !to) {
+    return std::nullopt;
+  }
+  return *to - *from;
+}
+
+RoastMetrics computeMetrics(EventSeries const& events, long smoothingWindow,
+                            std::string const& temperatureType) {
+  RoastMetrics metrics;
+
+  auto fill = events.earliestTimestamp(eventTypes::fill);
+  auto browning = events.earliestTimestamp(eventTypes::browning);
+  auto crack = events.earliestTimestamp(eventTypes::crack);
+  auto drop = events.earliestTimestamp(eventTypes::drop);
+  metrics.dryingTime = durationBetween(fill, browning);
+  metrics.maillardTime = durationBetween(browning, crack);
+  metrics.developmentTime = durationBetween(crack, drop);
+  metrics.totalTime = durationBetween(fill, drop);
+  if(metrics.developmentTime && metrics.totalTime && *metrics.totalTime > 0) {
+    metrics.developmentRatio =
+        static_cast<double>(*metrics.developmentTime) / static_cast<double>(*metrics.totalTime);
+  }
+
+  std::vector<long> timestamps;
+  std::vector<int> values;
+  events.decodeValues(temperatureType, timestamps, values);
+  metrics.readingCount = values.size();
+  if(values.empty()) {
+    return metrics;
+  }
+
+  auto const [min, max] = std::minmax_element(values.begin(), values.end());
+  metrics.minTemperature = *min;
+  metrics.maxTemperature = *max;
+  metrics.meanTemperature =
+      static_cast<double>(std::accumulate(values.begin(), values.end(), 0L)) / values.size();
+
+  // The start of every reading's window is found in one pass, the differences are then taken
+  // over contiguous arrays in a loop free of branches
+  auto count = values.size();
+  std::vector<size_t> windowStarts(count);
+  for(size_t i = 0, start = 0; i < count; i++) {
+    while(timestamps[i] - timestamps[start] > smoothingWindow) {
+      start++;
+    }
+    windowStarts[i] = start;
+  }
+
+  std::vector<double> rise(count);
+  std::vector<double> elapsed(count);
+  for(size_t i = 0; i < count; i++) {
+    rise[i] = values[i] - values[windowStarts[i]];
+    elapsed[i] = static_cast<double>(timestamps[i] - timestamps[windowStarts[i]]);
+  }
+
+  metrics.rateOfRise.reserve(count);
+  for(size_t i = 0; i < count; i++) {
+    // The first readings of a roast have nothing before them to compare with
+    if(elapsed[i] > 0) {
+      metrics.rateOfRise.push_back({timestamps[i], rise[i] * 60000.0 / elapsed[i]});
+    }
+  }
+  return metrics;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Model/RoastyModel.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Event types the roasting page records, marking where the phases of a roast begin and end
+namespace eventTypes {
+char const* const reading = "reading";
+char const* const fill = "fill";
+char const* const browning = "browning";
+char const* const crack = "crack";
+char const* const drop = "drop";
+} // namespace eventTypes
+
+// Temperature change in degrees per minute at one reading
+struct RateOfRise {
+  long timestamp;
+  double value;
+};
+
+// Figures derived from the events of a roast. Durations are in milliseconds like the timestamps
+// and are only set when the events bounding them were recorded.
+struct RoastMetrics {
+  std::optional<long> dryingTime;      // Fill to browning
+  std::optional<long> maillardTime;    // Browning to first crack
+  std::optional<long> developmentTime; // First crack to drop
+  std::optional<long> totalTime;       // Fill to drop
+  std::optional<double> developmentRatio;
+
+  size_t readingCount = 0;
+  std::optional<int> minTemperature;
+  std::optional<int> maxTemperature;
+  std::optional<double> meanTemperature;
+
+  std::vector<RateOfRise> rateOfRise;
+};
+
+// Rate of rise at every reading is taken over the readings of the smoothingWindow before it, so
+// the noise of single probe readings does not show in the curve
+RoastMetrics computeMetrics(EventSeries const& events, long smoothingWindow,
+                            std::string const& temperatureType = eventTypes::reading);
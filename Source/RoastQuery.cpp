@@ -0,0 +1,138 @@
+#include "RoastQuery.hpp"
+#include <algorithm>
+#include <tuple>
+
+static std::tuple<long, long> positionOf(Roast const& roast) {
+  return {roast.getTimestamp(), roast.getId()};
+}
+
+// A roast listing a bean twice is only indexed once
+static std::vector<BeanId> beansOf(Roast const& roast) {
+  std::vector<BeanId> beans;
+  for(auto i = 0; i < roast.getIngredientsCount(); i++) {
+    auto beanId = roast.getIngredient(i).getBeanId();
+    if(std::find(beans.begin(), beans.end(), beanId) == beans.end()) {
+      beans.push_back(beanId);
+    }
+  }
+  return beans;
+}
+
+static RoastList::iterator positionIn(RoastList& roasts, Roast const& roast) {
+  return std::lower_bound(roasts.begin(), roasts.end(), positionOf(roast),
+                          [](auto const& entry, std::tuple<long, long> const& position) {
+                            return positionOf(*entry) < position;
+                          });
+}
+
+static void removeFrom(RoastList& roasts, std::shared_ptr<Roast const> const& roast) {
+  auto it = positionIn(roasts, *roast);
+  if(it != roasts.end() && *it == roast) {
+    roasts.erase(it);
+  }
+}
+
+static void insertInto(RoastList& roasts, std::shared_ptr<Roast const> const& roast) {
+  roasts.insert(positionIn(roasts, *roast), roast);
+}
+
+RoastListIndex::RoastListIndex(RoastList const& roasts) : ordered(roasts) {
+  std::sort(ordered.begin(), ordered.end(),
+            [](auto const& a, auto const& b) { return positionOf(*a) < positionOf(*b); });
+
+  std::unordered_map<BeanId, RoastList> lists;
+  for(auto const& roast : ordered) {
+    for(auto beanId : beansOf(*roast)) {
+      lists[beanId].push_back(roast);
+    }
+  }
+  for(auto& [beanId, list] : lists) {
+    byBean.emplace(beanId, std::make_shared<RoastList const>(std::move(list)));
+  }
+}
+
+RoastListIndex RoastListIndex::updated(std::vector<RoastChange> const& changes) const {
+  RoastListIndex index;
+  index.ordered = ordered;
+  index.byBean = byBean;
+
+  // Copies of the bean lists the changes touch, written back once all changes are applied
+  std::unordered_map<BeanId, RoastList> touched;
+  auto listOf = [&](BeanId beanId) -> RoastList& {
+    auto it = touched.find(beanId);
+    if(it == touched.end()) {
+      auto shared = byBean.find(beanId);
+      it = touched.emplace(beanId, shared == byBean.end() ? RoastList{} : *shared->second).first;
+    }
+    return it->second;
+  };
+
+  for(auto const& change : changes) {
+    if(change.before) {
+      removeFrom(index.ordered, change.before);
+      for(auto beanId : beansOf(*change.before)) {
+        removeFrom(listOf(beanId), change.before);
+      }
+    }
+    if(change.after) {
+      insertInto(index.ordered, change.after);
+      for(auto beanId : beansOf(*change.after)) {
+        insertInto(listOf(beanId), change.after);
+      }
+    }
+  }
+
+  for(auto& [beanId, list] : touched) {
+    if(list.empty()) {
+      index.byBean.erase(beanId);
+    } else {
+      index.byBean[beanId] = std::make_shared<RoastList const>(std::move(list));
+    }
+  }
+  return index;
+}
+
+RoastPage RoastListIndex::find(RoastFilter const& filter, BeanCatalog const& catalog) const {
+  static RoastList const none;
+
+  auto const* roasts = &ordered;
+  if(filter.bean) {
+    BeanId beanId;
+    auto it = byBean.end();
+    if(catalog.find(*filter.bean, beanId)) {
+      it = byBean.find(beanId);
+    }
+    roasts = it == byBean.end() ? &none : it->second.get();
+  }
+
+  // Start at the first roast past both the cursor and the from timestamp
+  auto begin = roasts->begin();
+  if(filter.from) {
+    begin = std::lower_bound(begin, roasts->end(), *filter.from,
+                             [](auto const& roast, long from) {
+                               return roast->getTimestamp() < from;
+                             });
+  }
+  if(filter.after) {
+    auto after = std::make_tuple(filter.after->beginTimestamp, filter.after->id);
+    begin = std::upper_bound(begin, roasts->end(), after,
+                             [](std::tuple<long, long> const& after, auto const& roast) {
+                               return after < positionOf(*roast);
+                             });
+  }
+
+  auto inRange = [&](auto it) {
+    return it != roasts->end() && (!filter.to || (*it)->getTimestamp() < *filter.to);
+  };
+
+  RoastPage page;
+  auto it = begin;
+  for(; inRange(it) && page.roasts.size() < filter.limit; ++it) {
+    page.roasts.push_back(*it);
+  }
+  if(!page.roasts.empty() && inRange(it)) {
+    auto& last = *page.roasts.back();
+    page.next = RoastCursor{last.getTimestamp(), last.getId()};
+  }
+  return page;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Model/RoastyModel.hpp"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Immutable roasts, shared by every snapshot and page they appear in
+using RoastList = std::vector<std::shared_ptr<Roast const>>;
+
+// Roast lists are paged in order of beginTimestamp, ties broken by id. A cursor is the position of
+// the last roast a client has seen.
+struct RoastCursor {
+  long beginTimestamp;
+  long id;
+};
+
+struct RoastFilter {
+  std::optional<RoastCursor> after;
+  size_t limit = 100;
+  std::optional<long> from; // Earliest beginTimestamp, inclusive
+  std::optional<long> to;   // Latest beginTimestamp, exclusive
+  std::optional<std::string> bean;
+};
+
+struct RoastPage {
+  RoastList roasts;
+  std::optional<RoastCursor> next; // Set if more roasts match after this page
+  unsigned long version = 0;       // Of the snapshot the page was found in
+};
+
+// A roast as it was in one snapshot and as it is in the next, either is empty if there was none
+struct RoastChange {
+  std::shared_ptr<Roast const> before;
+  std::shared_ptr<Roast const> after;
+};
+
+// Sorted index on beginTimestamp and inverted index from bean to the roasts using it. A page is
+// found in O(log n + page size).
+class RoastListIndex {
+public:
+  explicit RoastListIndex(RoastList const& roasts);
+
+  // The index of the next snapshot, without sorting again. Only the lists of the beans the changed
+  // roasts use are copied, the others are shared with this index.
+  RoastListIndex updated(std::vector<RoastChange> const& changes) const;
+
+  // The bean filtered on is looked up in the catalog the roasts' beans were interned by
+  RoastPage find(RoastFilter const& filter, BeanCatalog const& catalog) const;
+
+private:
+  RoastListIndex() = default;
+
+  RoastList ordered;
+  // In the same order as ordered
+  std::unordered_map<BeanId, std::shared_ptr<RoastList const>> byBean;
+};
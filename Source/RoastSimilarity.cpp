@@ -0,0 +1,123 @@
+#include "RoastSimilarity.hpp"
+#include "RoastMetrics.hpp"
+#include <algorithm>
+#include <cmath>
+
+std::optional<RoastFingerprint> fingerprintOf(EventSeries const& events) {
+  std::vector<long> timestamps;
+  std::vector<int> values;
+  events.decodeValues(std::string{eventTypes::reading}, timestamps, values);
+  if(values.empty()) {
+    return std::nullopt;
+  }
+
+  auto start = events.earliestTimestamp(eventTypes::fill).value_or(timestamps.front());
+  RoastFingerprint fingerprint{};
+  fingerprint.length = 0;
+
+  // Walk the grid and the readings together, interpolating between the readings either side
+  size_t next = 0;
+  for(auto i = 0U; i < fingerprintLength; i++) {
+    auto t = start + static_cast<long>(i) * fingerprintSpacing;
+    while(next < timestamps.size() && timestamps[next] < t) {
+      next++;
+    }
+
+    float temperature;
+    if(next == 0) {
+      temperature = values.front();
+    } else if(next == timestamps.size()) {
+      temperature = values.back();
+    } else {
+      auto before = next - 1;
+      auto fraction = static_cast<float>(t - timestamps[before]) /
+                      static_cast<float>(timestamps[next] - timestamps[before]);
+      temperature = values[before] + fraction * static_cast<float>(values[next] - values[before]);
+    }
+    fingerprint.temperatures[i] = temperature;
+    if(t <= timestamps.back()) {
+      fingerprint.length = i + 1;
+    }
+  }
+  fingerprint.length = std::max<size_t>(fingerprint.length, 1);
+  return fingerprint;
+}
+
+void SimilarityIndex::update(long roastId, EventSeries const& events) {
+  auto fingerprint = fingerprintOf(events);
+  if(!fingerprint) {
+    remove(roastId);
+    return;
+  }
+
+  auto [it, added] = slots.emplace(roastId, ids.size());
+  if(added) {
+    ids.push_back(roastId);
+    lengths.push_back(0);
+    temperatures.resize(temperatures.size() + fingerprintLength);
+  }
+  auto slot = it->second;
+  lengths[slot] = fingerprint->length;
+  std::copy(fingerprint->temperatures.begin(), fingerprint->temperatures.end(),
+            temperatures.begin() + slot * fingerprintLength);
+}
+
+// The last slot is moved into the one freed so the arrays stay dense
+void SimilarityIndex::remove(long roastId) {
+  auto it = slots.find(roastId);
+  if(it == slots.end()) {
+    return;
+  }
+  auto slot = it->second;
+  auto last = ids.size() - 1;
+  if(slot != last) {
+    ids[slot] = ids[last];
+    lengths[slot] = lengths[last];
+    std::copy(temperatures.begin() + last * fingerprintLength, temperatures.end(),
+              temperatures.begin() + slot * fingerprintLength);
+    slots[ids[slot]] = slot;
+  }
+  slots.erase(it);
+  ids.pop_back();
+  lengths.pop_back();
+  temperatures.resize(last * fingerprintLength);
+}
+
+std::vector<SimilarRoast> SimilarityIndex::nearest(long roastId, size_t k) const {
+  auto it = slots.find(roastId);
+  if(it == slots.end()) {
+    return {};
+  }
+
+  // Points past the query's length weigh nothing, so every distance is the same branch free,
+  // fixed length loop over contiguous floats
+  std::array<float, fingerprintLength> query;
+  std::array<float, fingerprintLength> weights{};
+  auto length = lengths[it->second];
+  std::copy_n(temperatures.begin() + it->second * fingerprintLength, fingerprintLength,
+              query.begin());
+  std::fill_n(weights.begin(), length, 1.0F);
+
+  std::vector<SimilarRoast> candidates;
+  candidates.reserve(ids.size());
+  for(auto slot = 0U; slot < ids.size(); slot++) {
+    if(ids[slot] == roastId) {
+      continue;
+    }
+    auto const* other = temperatures.data() + slot * fingerprintLength;
+    float sum = 0;
+    for(auto i = 0U; i < fingerprintLength; i++) {
+      auto difference = query[i] - other[i];
+      sum += weights[i] * difference * difference;
+    }
+    candidates.push_back({ids[slot], std::sqrt(sum / length)});
+  }
+
+  k = std::min(k, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(),
+                    [](auto const& a, auto const& b) {
+                      return a.distance < b.distance || (a.distance == b.distance && a.id < b.id);
+                    });
+  candidates.resize(k);
+  return candidates;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Model/RoastyModel.hpp"
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// A roast's temperature curve resampled every fingerprintSpacing milliseconds from the fill, or
+// from the first reading if the fill was not recorded. Only the first length points were reached
+// by the readings, the rest repeat the last temperature.
+size_t const fingerprintLength = 32;
+long const fingerprintSpacing = 30 * 1000;
+
+struct RoastFingerprint {
+  std::array<float, fingerprintLength> temperatures;
+  size_t length;
+};
+
+// No fingerprint for roasts without readings
+std::optional<RoastFingerprint> fingerprintOf(EventSeries const& events);
+
+struct SimilarRoast {
+  long id;
+  double distance; // Root mean square temperature difference over the curve compared
+};
+
+// Fingerprints of all roasts held in one flat array, compared by brute force. Curves are compared
+// over the length of the query only, so a roast still in progress finds the roasts that began
+// like it did.
+class SimilarityIndex {
+public:
+  // Adds, replaces or, for roasts without readings, removes the fingerprint of roastId
+  void update(long roastId, EventSeries const& events);
+  void remove(long roastId);
+
+  // Empty if roastId has no fingerprint
+  std::vector<SimilarRoast> nearest(long roastId, size_t k) const;
+
+private:
+  std::vector<long> ids;
+  std::vector<float> temperatures; // fingerprintLength floats per slot
+  std::unordered_map<long, size_t> slots;
+  std::vector<size_t> lengths;
+};
@@ -5,7 +5,10 @@
 #include "Utilities.hpp"
 #include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
+#include <unordered_set>
 
 template <typename StorageImplementation> void Roasty<StorageImplementation>::startServer() {
   std::cout << "Listening on http://" << roastyServer.getInterface() << ":"
@@ -19,6 +22,7 @@ template <typename StorageImplementation> void Roasty<StorageImplementation>::st
 // ==================== Bean ========================
 template <typename RoastyImplementation>
 std::vector<Bean> Roasty<RoastyImplementation>::allBeans() {
+  std::shared_lock lock{mutex};
   return storage->getBeans();
 }
 
@@ -29,100 +33,239 @@ auto const check_unique = [](auto& container, auto comparator) {
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::addBean(const Bean& bean) {
-  auto allBean = storage->getBeans();
-
-  if(!check_unique(allBean, [&bean](const auto& b) { return b.getName() == bean.getName(); })) {
+  std::unique_lock lock{mutex};
+  size_t position;
+  if(storage->findBean(bean, position)) {
     throw RoastyServerException{"Cannot add bean, they already exist.", errorCode};
   }
   storage->addBean(bean);
+  beansChanged();
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::deleteBean(const Bean& bean) {
-  for(auto i = 0U; i < storage->getBeans().size(); i++) {
-    if(storage->getBean(i).getName() == bean.getName()) {
-      storage->removeBean(i);
-      return;
-    }
+  std::unique_lock lock{mutex};
+  size_t position;
+  if(storage->findBean(bean, position)) {
+    storage->removeBean(position);
+    beansChanged();
   }
 }
 
 template <typename RoastyImplementation>
-void Roasty<RoastyImplementation>::renameBean(const Bean& bean, std::string const& newName) {
-  for(auto i = 0U; i < storage->getBeans().size(); i++) {
-    if(storage->getBean(i).getName() == bean.getName()) {
-      storage->replaceBean(i, Bean{storage->getBean(i).getName()});
-    }
+void Roasty<RoastyImplementation>::renameBean(const Bean& bean, std::string const& newName,
+                                              WriteCondition const& condition) {
+  std::unique_lock lock{mutex};
+  if(!condition.allows(beansVersion())) {
+    throw RoastyServerException{"Beans were changed since they were read", preconditionFailed};
+  }
+
+  size_t position;
+  if(!storage->findBean(bean, position)) {
+    return;
   }
-};
+
+  // A name only ingredients use is taken as well, the bean would otherwise end up as a second
+  // bean of that name that filters and reports count apart
+  size_t existing;
+  BeanId used;
+  if(storage->findBean(Bean{newName}, existing) || storage->getCatalog().find(newName, used)) {
+    throw RoastyServerException{"Cannot rename bean, name already in use.", errorCode};
+  }
+  storage->renameBean(position, newName);
+  beansChanged();
+  allRoastsChanged();
+}
 
 // ====================== Roast =========================
 template <typename RoastyImplementation>
 std::vector<Roast> Roasty<RoastyImplementation>::allRoasts() {
-  return storage->getRoasts();
+  auto snapshot = roastsSnapshot();
+  std::vector<Roast> roasts;
+  for(auto const& roast : *snapshot.roasts) {
+    roasts.push_back(*roast);
+  }
+  return roasts;
 }
 
-template <typename RoastyImplementation> Roast& Roasty<RoastyImplementation>::getRoast(long id) {
-  auto& allRoasts = storage->getRoasts();
+template <typename RoastyImplementation>
+typename Roasty<RoastyImplementation>::RoastsSnapshot
+Roasty<RoastyImplementation>::roastsSnapshot() {
+  auto current = publishedRoastsSnapshot();
+  return {current->version, {current, &current->roasts}};
+}
 
-  auto it = std::find_if(allRoasts.begin(), allRoasts.end(),
-                         [id](auto& elem) { return elem.getId() == id; });
+template <typename RoastyImplementation>
+std::shared_ptr<typename Roasty<RoastyImplementation>::PublishedRoasts const>
+Roasty<RoastyImplementation>::publishedRoastsSnapshot() {
+  auto current = std::atomic_load(&publishedRoasts);
+  if(current && current->version == roastsVersion()) {
+    return current;
+  }
 
-  if(it == allRoasts.end()) {
-    throw RoastyServerException{"Unknown roast id", errorCode};
+  // While a writer holds the lock the previous version is served instead of waiting for it
+  std::shared_lock lock{mutex, std::try_to_lock};
+  if(!lock.owns_lock()) {
+    if(current) {
+      return current;
+    }
+    lock.lock();
   }
 
-  return *it;
+  // Another reader may have published the same version while this one waited
+  std::lock_guard publishing{publishMutex};
+  current = std::atomic_load(&publishedRoasts);
+  if(current && current->version == roastsVersion()) {
+    return current;
+  }
+
+  std::unordered_map<long, std::shared_ptr<Roast const>> written;
+  for(auto id : unpublishedIds) {
+    auto it = publishedById.find(id);
+    if(it != publishedById.end()) {
+      written.emplace(id, std::move(it->second));
+      publishedById.erase(it);
+    }
+  }
+  unpublishedIds.clear();
+
+  auto fresh = std::make_shared<PublishedRoasts>();
+  fresh->version = roastsVersion();
+  std::vector<RoastChange> changes;
+  auto const& roasts = storage->getRoasts();
+  fresh->roasts.reserve(roasts.size());
+  for(auto const& roast : roasts) {
+    auto& published = publishedById[roast.getId()];
+    if(!published) {
+      published = std::make_shared<Roast const>(roast);
+      auto before = written.find(roast.getId());
+      if(before == written.end()) {
+        changes.push_back({nullptr, published});
+      } else {
+        changes.push_back({std::move(before->second), published});
+        written.erase(before);
+      }
+    }
+    fresh->roasts.push_back(published);
+  }
+  for(auto& [id, before] : written) {
+    changes.push_back({std::move(before), nullptr});
+  }
+
+  if(auto index = current ? std::atomic_load(&current->index) : nullptr) {
+    fresh->index = std::make_shared<RoastListIndex const>(index->updated(changes));
+  }
+  std::atomic_store(&publishedRoasts, std::shared_ptr<PublishedRoasts const>{fresh});
+  return fresh;
 }
 
 template <typename RoastyImplementation>
-void Roasty<RoastyImplementation>::addRoast(Roast const& roast) {
-  auto& roasts = storage->getRoasts();
-  for(auto i = 0U; i < roasts.size(); i++) {
-    if(roasts[i].getId() == roast.getId()) {
-      throw RoastyServerException{"Cannot add roast, id already exists.", errorCode};
+RoastPage Roasty<RoastyImplementation>::findRoasts(RoastFilter const& filter) {
+  auto current = publishedRoastsSnapshot();
+
+  // Built here only when the version before had no index to update
+  std::call_once(current->indexed, [&] {
+    if(!std::atomic_load(&current->index)) {
+      std::atomic_store(&current->index,
+                        std::make_shared<RoastListIndex const>(current->roasts));
     }
+  });
+  auto page = std::atomic_load(&current->index)->find(filter, storage->getCatalog());
+  page.version = current->version;
+  return page;
+}
+
+template <typename RoastyImplementation>
+unsigned long Roasty<RoastyImplementation>::roastVersion(long id) {
+  std::shared_lock lock{mutex};
+  return currentRoastVersion(id);
+}
+
+template <typename RoastyImplementation>
+unsigned long Roasty<RoastyImplementation>::currentRoastVersion(long id) const {
+  auto it = roastVersions.find(id);
+  return it == roastVersions.end() ? renameVersion : std::max(it->second, renameVersion);
+}
+
+// Checked under the same exclusive lock as the write, so nothing can change the roast in between
+template <typename RoastyImplementation>
+void Roasty<RoastyImplementation>::checkRoastVersion(long id,
+                                                     WriteCondition const& condition) const {
+  if(!condition.allows(currentRoastVersion(id))) {
+    throw RoastyServerException{"Roast was changed since it was read", preconditionFailed};
   }
-  roasts.push_back(roast);
-  storage->setRoasts(roasts);
 }
 
-template <typename RoastyImplementation> void Roasty<RoastyImplementation>::deleteRoast(long id) {
-  auto& allRoasts = storage->getRoasts();
-  allRoasts.erase(std::remove_if(allRoasts.begin(), allRoasts.end(),
-                                 [id](auto& elem) { return elem.getId() == id; }),
-                  allRoasts.end());
-  storage->setRoasts(allRoasts);
+template <typename RoastyImplementation>
+Roast Roasty<RoastyImplementation>::getRoast(long id) {
+  std::shared_lock lock{mutex};
+  return findRoast(id);
+}
+
+template <typename RoastyImplementation>
+typename Roasty<RoastyImplementation>::VersionedRoast
+Roasty<RoastyImplementation>::getVersionedRoast(long id) {
+  std::shared_lock lock{mutex};
+  return {currentRoastVersion(id), findRoast(id)};
+}
+
+template <typename RoastyImplementation>
+Roast const& Roasty<RoastyImplementation>::findRoast(long id) {
+  auto const* roast = storage->findRoast(id);
+
+  if(roast == nullptr) {
+    throw RoastyServerException{"Unknown roast id", errorCode};
+  }
+
+  return *roast;
 }
 
 template <typename RoastyImplementation>
-void Roasty<RoastyImplementation>::replaceRoast(long oldId, const Roast& newRoast) {
-  auto allRoasts = storage->getRoasts();
+void Roasty<RoastyImplementation>::addRoast(Roast const& roast) {
+  std::unique_lock lock{mutex};
+  if(storage->findRoast(roast.getId()) != nullptr) {
+    throw RoastyServerException{"Cannot add roast, id already exists.", errorCode};
+  }
+  storage->addRoast(roast);
+  roastChanged(roast.getId());
+}
 
-  auto it = std::find_if(allRoasts.begin(), allRoasts.end(),
-                         [oldId](auto& elem) { return elem.getId() == oldId; });
+template <typename RoastyImplementation> void Roasty<RoastyImplementation>::deleteRoast(long id) {
+  std::unique_lock lock{mutex};
+  storage->removeRoast(id);
+  roastChanged(id);
+}
 
-  if(it == allRoasts.end()) {
+template <typename RoastyImplementation>
+void Roasty<RoastyImplementation>::replaceRoast(long oldId, const Roast& newRoast,
+                                                WriteCondition const& condition) {
+  std::unique_lock lock{mutex};
+  if(storage->findRoast(oldId) == nullptr) {
     throw RoastyServerException{"Unknown roast id", errorCode};
   }
+  checkRoastVersion(oldId, condition);
+  if(newRoast.getId() != oldId && storage->findRoast(newRoast.getId()) != nullptr) {
+    throw RoastyServerException{"Cannot replace roast, id already exists.", errorCode};
+  }
 
-  *it = newRoast;
-  storage->setRoasts(allRoasts);
+  storage->replaceRoast(oldId, newRoast);
+  roastChanged(oldId);
+  roastChanged(newRoast.getId());
 }
 
 template <typename RoastyImplementation>
 Ingredient Roasty<RoastyImplementation>::getIngredientByBeanName(long roastId,
                                                                  std::string const& beanName) {
-  auto& roast = getRoast(roastId);
+  std::shared_lock lock{mutex};
+  auto& roast = findRoast(roastId);
 
   auto ingredients = RangeGenerator<const Ingredient>(
       [&](auto i) -> Ingredient const& { return roast.getIngredient(i); },
       roast.getIngredientsCount());
 
-  auto it =
-      std::find_if(ingredients.begin(), ingredients.end(), [&beanName](const auto& ingredient) {
-        return ingredient.getBean().getName() == beanName;
-      });
+  auto it = std::find_if(
+      ingredients.begin(), ingredients.end(),
+      [&beanName](const auto& ingredient) { return ingredient.getBean().getName() == beanName; });
   if(it == ingredients.end()) {
     std::stringstream message{};
     message << "No bean with name " << beanName << " in roast " << roastId;
@@ -135,84 +278,170 @@ Ingredient Roasty<RoastyImplementation>::getIngredientByBeanName(long roastId,
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::addIngredientToRoast(long roastId,
                                                         const Ingredient& ingredient) {
-  auto roast = getRoast(roastId);
+  std::unique_lock lock{mutex};
+  auto& roast = findRoast(roastId);
 
   auto ingredients = RangeGenerator<const Ingredient>(
       [&](auto i) -> Ingredient const& { return roast.getIngredient(i); },
       roast.getIngredientsCount());
 
-  if(!check_unique(ingredients, [&ingredient](const auto& b) {
-       return b.getBean().getName() == ingredient.getBean().getName();
-     })) {
+  auto beanName = ingredient.getBean().getName();
+  if(!check_unique(ingredients,
+                   [&beanName](const auto& b) { return b.getBean().getName() == beanName; })) {
     throw RoastyServerException{"Cannot add ingredient, ingredient already exists.", errorCode};
   }
-  roast.addIngredient(ingredient);
-  replaceRoast(roastId, roast);
+  storage->addIngredient(roastId, ingredient);
+  roastChanged(roastId);
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::removeIngredientFromRoast(long roastId,
                                                              std::string const& beanName) {
-  auto roast = getRoast(roastId);
-  roast.removeIngredientByBeanName(beanName);
-  replaceRoast(roastId, roast);
+  std::unique_lock lock{mutex};
+  findRoast(roastId);
+  storage->removeIngredient(roastId, beanName);
+  roastChanged(roastId);
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::updateIngredient(long roastId, std::string const& beanName,
-                                                    int newAmount) {
-  auto roast = getRoast(roastId);
-  auto* newIngredient = new Ingredient{*(new Bean{beanName}), newAmount};
-  roast.removeIngredientByBeanName(beanName);
-  roast.addIngredient(*newIngredient);
-
-  replaceRoast(roastId, roast);
+                                                    int newAmount,
+                                                    WriteCondition const& condition) {
+  std::unique_lock lock{mutex};
+  findRoast(roastId);
+  checkRoastVersion(roastId, condition);
+  storage->updateIngredient(roastId, beanName, newAmount);
+  roastChanged(roastId);
 }
 
 template <typename RoastyImplementation>
 Event Roasty<RoastyImplementation>::getEventById(long roastId, long eventTimestamp) {
-  auto& roast = getRoast(roastId);
-  auto events = RangeGenerator<const Event>(
-      [&](auto i) -> Event const& { return roast.getEvent(i); }, roast.getEventCount());
+  std::shared_lock lock{mutex};
+  auto event = findRoast(roastId).findEvent(eventTimestamp);
 
-  auto it = std::find_if(events.begin(), events.end(), [eventTimestamp](const auto& event) {
-    return event.getTimestamp() == eventTimestamp;
-  });
-
-  if(it == events.end()) {
+  if(!event) {
     std::stringstream message{};
     message << "No event with timestamp " << eventTimestamp << " in roast" << roastId;
     throw RoastyServerException(message.str(), errorCode);
   }
 
-  return *it;
+  return *event;
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::addEventToRoast(long roastId, const Event& e) {
-  auto roast = getRoast(roastId);
-  for (auto i = 0u; i < roast.getEventCount(); i++) {
-    if(roast.getEvent(i).getTimestamp() == e.getTimestamp())
-      throw RoastyServerException{"Cannot add event, id already exists.", errorCode};
+  std::unique_lock lock{mutex};
+  if(findRoast(roastId).findEvent(e.getTimestamp())) {
+    throw RoastyServerException{"Cannot add event, id already exists.", errorCode};
+  }
+  storage->addEvent(roastId, e);
+  roastChanged(roastId);
+}
+
+template <typename RoastyImplementation>
+std::vector<EventBucket>
+Roasty<RoastyImplementation>::aggregateEvents(long roastId, long bucketWidth,
+                                              std::optional<std::string> const& type) {
+  std::shared_lock lock{mutex};
+  return ::aggregateEvents(findRoast(roastId).getEventSeries(), bucketWidth, type);
+}
+
+template <typename RoastyImplementation>
+RoastMetrics Roasty<RoastyImplementation>::roastMetrics(long roastId, long smoothingWindow,
+                                                        std::string const& temperatureType) {
+  std::shared_lock lock{mutex};
+  return computeMetrics(findRoast(roastId).getEventSeries(), smoothingWindow, temperatureType);
+}
+
+template <typename RoastyImplementation>
+std::vector<SimilarRoast> Roasty<RoastyImplementation>::similarRoasts(long roastId, size_t k) {
+  std::shared_lock lock{mutex};
+  findRoast(roastId);
+  std::call_once(similarityBuilt, [this] {
+    for(auto const& roast : storage->getRoasts()) {
+      similarity.update(roast.getId(), roast.getEventSeries());
+    }
+    similarityIndexed = true;
+  });
+
+  std::lock_guard<std::mutex> refreshLock{similarityMutex};
+  for(auto id : staleFingerprints) {
+    if(auto const* roast = storage->findRoast(id)) {
+      similarity.update(id, roast->getEventSeries());
+    } else {
+      similarity.remove(id);
+    }
   }
-  roast.addEvent(e);
-  replaceRoast(roastId, roast);
+  staleFingerprints.clear();
+  return similarity.nearest(roastId, k);
+}
+
+template <typename RoastyImplementation>
+std::vector<BeanUsageReport>
+Roasty<RoastyImplementation>::beanUsage(std::optional<std::string> const& bean,
+                                        std::optional<long> from, std::optional<long> to) {
+  std::shared_lock lock{mutex};
+  std::call_once(beanUsageBuilt, [this] {
+    for(auto const& roast : storage->getRoasts()) {
+      beanUsageIndex.update(roast.getId(), &roast);
+    }
+    beanUsageIndexed = true;
+  });
+  return beanUsageIndex.report(storage->getCatalog(), bean, from, to);
+}
+
+template <typename RoastyImplementation>
+void Roasty<RoastyImplementation>::updateIndexes(long id) {
+  if(!similarityIndexed && !beanUsageIndexed) {
+    return;
+  }
+  if(similarityIndexed) {
+    staleFingerprints.insert(id);
+  }
+  if(beanUsageIndexed) {
+    beanUsageIndex.update(id, storage->findRoast(id));
+  }
+}
+
+// The whole batch is checked against the roast and itself before any of it is stored
+template <typename RoastyImplementation>
+void Roasty<RoastyImplementation>::addEventsToRoast(long roastId,
+                                                    std::vector<Event> const& events) {
+  std::unique_lock lock{mutex};
+  auto& roast = findRoast(roastId);
+  std::unordered_set<long> timestamps;
+  for(auto& event : events) {
+    if(!timestamps.insert(event.getTimestamp()).second || roast.findEvent(event.getTimestamp())) {
+      throw RoastyServerException{"Cannot add events, id already exists.", errorCode};
+    }
+  }
+  if(events.empty()) {
+    return;
+  }
+  storage->addEvents(roastId, events);
+  roastChanged(roastId);
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::removeEventFromRoast(long roastId, long eventTimestamp) {
-  auto roast = getRoast(roastId);
-  roast.removeEventByTimestamp(eventTimestamp);
-  replaceRoast(roastId, roast);
+  std::unique_lock lock{mutex};
+  findRoast(roastId);
+  storage->removeEvent(roastId, eventTimestamp);
+  roastChanged(roastId);
 }
 
 template <typename RoastyImplementation>
 void Roasty<RoastyImplementation>::replaceEventInRoast(long roastId, long oldEventTimestamp,
-                                                       const Event& newEvent) {
-  auto roast = getRoast(roastId);
-  roast.removeEventByTimestamp(oldEventTimestamp);
-  roast.addEvent(newEvent);
-  replaceRoast(roastId, roast);
+                                                       const Event& newEvent,
+                                                       WriteCondition const& condition) {
+  std::unique_lock lock{mutex};
+  auto& roast = findRoast(roastId);
+  checkRoastVersion(roastId, condition);
+  if(newEvent.getTimestamp() != oldEventTimestamp && roast.findEvent(newEvent.getTimestamp())) {
+    throw RoastyServerException{"Cannot replace event, id already exists.", errorCode};
+  }
+  storage->replaceEvent(roastId, oldEventTimestamp, newEvent);
+  roastChanged(roastId);
 }
 
 template struct Roasty<MemoryStorage>;
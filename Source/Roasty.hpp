@@ -1,14 +1,50 @@
 #pragma once
 
 #include "Model/RoastyModel.hpp"
+#include "BeanUsage.hpp"
+#include "EventAggregation.hpp"
+#include "RoastMetrics.hpp"
+#include "RoastQuery.hpp"
+#include "RoastSimilarity.hpp"
 #include "Server/RoastyServer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+// Versions a conditional write accepts (If-Match), an unconditional write accepts any version
+struct WriteCondition {
+  bool conditional = false;
+  std::vector<unsigned long> versions;
+
+  bool allows(unsigned long version) const {
+    return !conditional || std::find(versions.begin(), versions.end(), version) != versions.end();
+  }
+};
+
+// Requests are handled on the server's worker threads. Reads share the lock, every write holds it
+// exclusively, and results are returned by value so nothing refers into storage once it is released.
 template <typename StorageImplementation> struct Roasty {
 public:
   static auto const errorCode = 400;
+  static auto const preconditionFailed = 412;
 
-  explicit Roasty(StorageImplementation* storage) : storage(storage) {}
+  explicit Roasty(StorageImplementation* storage) : storage(storage) {
+    // Versions start from the startup time so that tags handed out before a restart never match
+    auto startup = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    latestRoastsVersion = startup;
+    renameVersion = startup;
+    latestBeansVersion = startup;
+  }
 
   void startServer();
 
@@ -16,29 +52,125 @@ public:
   std::vector<Bean> allBeans();
   void addBean(const Bean& bean);
   void deleteBean(const Bean& bean);
-  void renameBean(const Bean& bean, std::string const& newName);
+  void renameBean(const Bean& bean, std::string const& newName,
+                  WriteCondition const& condition = {});
 
   // ============== Roasts ================
   std::vector<Roast> allRoasts();
-  Roast& getRoast(long id);
+  // All roasts as of version, shared by every reader until a write publishes a newer snapshot
+  struct RoastsSnapshot {
+    unsigned long version;
+    std::shared_ptr<RoastList const> roasts;
+  };
+  RoastsSnapshot roastsSnapshot();
+  // One page of the roasts matching filter, served from the current snapshot and carrying its
+  // version
+  RoastPage findRoasts(RoastFilter const& filter);
+  Roast getRoast(long id);
+  // The roast together with its version, both read under one lock so they always match
+  struct VersionedRoast {
+    unsigned long version;
+    Roast roast;
+  };
+  VersionedRoast getVersionedRoast(long id);
   void addRoast(Roast const& r);
   void deleteRoast(long id);
-  void replaceRoast(long oldId, const Roast& newRoast);
+  void replaceRoast(long oldId, const Roast& newRoast, WriteCondition const& condition = {});
 
   // ============== Ingredients ================
   Ingredient getIngredientByBeanName(long roastId, std::string const& beanName);
   void addIngredientToRoast(long roastId, Ingredient const& ingredient);
   void removeIngredientFromRoast(long roastId, std::string const& beanName);
-  void updateIngredient(long roastId, std::string const& beanName, int newAmount);
+  void updateIngredient(long roastId, std::string const& beanName, int newAmount,
+                        WriteCondition const& condition = {});
+
+  // ============== Versions ================
+  // Change whenever a write touches the data behind the matching read, so encoded responses can
+  // be reused while the version stays the same
+  unsigned long roastsVersion() const { return latestRoastsVersion.load(std::memory_order_acquire); }
+  unsigned long roastVersion(long id);
+  unsigned long beansVersion() const { return latestBeansVersion.load(std::memory_order_acquire); }
 
   // ============== Events ================
   Event getEventById(long roastId, long eventId);
   void addEventToRoast(long roastId, const Event& e);
+  // Adds all events or none of them, as one write
+  void addEventsToRoast(long roastId, std::vector<Event> const& events);
   void removeEventFromRoast(long roastId, long eventTimestamp);
-  void replaceEventInRoast(long roastId, long oldEventTimestamp, const Event& newEvent);
+  void replaceEventInRoast(long roastId, long oldEventTimestamp, const Event& newEvent,
+                           WriteCondition const& condition = {});
+
+  // ============== Stats ================
+  // Event values of a roast aggregated over windows bucketWidth long
+  std::vector<EventBucket> aggregateEvents(long roastId, long bucketWidth,
+                                           std::optional<std::string> const& type);
+  RoastMetrics roastMetrics(long roastId, long smoothingWindow, std::string const& temperatureType);
+  // The k roasts whose temperature curves are closest to that of roastId
+  std::vector<SimilarRoast> similarRoasts(long roastId, size_t k);
+  std::vector<BeanUsageReport> beanUsage(std::optional<std::string> const& bean,
+                                         std::optional<long> from, std::optional<long> to);
 
 private:
   int const defaultPort = 1234;
   RoastyServer<Roasty<StorageImplementation>> roastyServer{"localhost", defaultPort, this};
   StorageImplementation* storage;
+  std::shared_mutex mutex;
+
+  // Throws for unknown ids; the reference is only valid while the lock is held
+  Roast const& findRoast(long id);
+
+  // Every roast write bumps the version, the next snapshot request after it copies the roasts
+  // written since the last snapshot and shares the others with it. Only accessed through
+  // std::atomic_load/atomic_store.
+  struct PublishedRoasts {
+    unsigned long version;
+    RoastList roasts;
+    // Updated from the index of the version before if that one has an index, otherwise built by
+    // the first paged query. Only accessed through std::atomic_load/atomic_store.
+    mutable std::once_flag indexed;
+    mutable std::shared_ptr<RoastListIndex const> index;
+  };
+  std::shared_ptr<PublishedRoasts const> publishedRoasts;
+  std::shared_ptr<PublishedRoasts const> publishedRoastsSnapshot();
+  // The copies handed out so far and the ids written since. Changed by writers under the exclusive
+  // lock, or by the reader publishing a snapshot under the shared lock and publishMutex.
+  std::mutex publishMutex;
+  std::unordered_map<long, std::shared_ptr<Roast const>> publishedById;
+  std::unordered_set<long> unpublishedIds;
+
+  // A roast's version is the collection version of the last write to it, or of the last bean
+  // rename if that is newer since renames show up in every roast. Guarded by the lock.
+  std::atomic<unsigned long> latestRoastsVersion{0};
+  std::unordered_map<long, unsigned long> roastVersions;
+  unsigned long renameVersion = 0;
+  unsigned long currentRoastVersion(long id) const;
+  void checkRoastVersion(long id, WriteCondition const& condition) const;
+  void roastChanged(long id) {
+    auto version = latestRoastsVersion.load(std::memory_order_relaxed) + 1;
+    roastVersions[id] = version;
+    unpublishedIds.insert(id);
+    latestRoastsVersion.store(version, std::memory_order_release);
+    updateIndexes(id);
+  }
+  void allRoastsChanged() {
+    renameVersion = latestRoastsVersion.load(std::memory_order_relaxed) + 1;
+    latestRoastsVersion.store(renameVersion, std::memory_order_release);
+  }
+
+  // Built by the first search or report needing them, under the shared lock, then kept in step by
+  // every roast write under the exclusive lock. Fingerprints take the whole curve, so a write only
+  // marks its roast stale and the next search refreshes it, under similarityMutex as searches run
+  // concurrently.
+  SimilarityIndex similarity;
+  std::once_flag similarityBuilt;
+  bool similarityIndexed = false;
+  std::unordered_set<long> staleFingerprints;
+  std::mutex similarityMutex;
+  BeanUsageIndex beanUsageIndex;
+  std::once_flag beanUsageBuilt;
+  bool beanUsageIndexed = false;
+  void updateIndexes(long id);
+
+  std::atomic<unsigned long> latestBeansVersion{0};
+  void beansChanged() { latestBeansVersion.fetch_add(1, std::memory_order_release); }
 };
@@ -1,14 +1,25 @@
 #include "Serialisation.hpp"
 #include "Server/RoastyServerException.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
 #include <exception>
+#include <iterator>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using json = nlohmann::json;
 
 template <typename T> T parseWithErrorHandling(std::function<T()> action) {
   try {
     return action();
+  } catch(RoastyServerException& e) {
+    throw;
   } catch(json::parse_error& e) {
     throw RoastyServerException(e.what(), 400);
   } catch(json::type_error& e) {
@@ -18,20 +29,107 @@ template <typename T> T parseWithErrorHandling(std::function<T()> action) {
   }
 }
 
-json roastToJson(const Roast& r) {
-  // clang-format off
-  json roast {
-    {"id", r.getId()},
-    {"beginTimestamp", r.getTimestamp()}
+// ==================== Wire formats =============================
+WireFormat wireFormatOf(std::string const& mediaTypes) {
+  auto format = WireFormat::Json;
+  auto first = std::string::npos;
+
+  // The first binary format named wins, anything else is answered with json
+  auto consider = [&](char const* mediaType, WireFormat candidate) {
+    auto position = mediaTypes.find(mediaType);
+    if(position < first) {
+      first = position;
+      format = candidate;
+    }
   };
-  // clang-format on
+  consider("application/cbor", WireFormat::Cbor);
+  consider("application/msgpack", WireFormat::MessagePack);
+  consider("application/x-msgpack", WireFormat::MessagePack);
+
+  return format;
+}
 
-  for(auto i = 0U; i < r.getEventCount(); i++) {
-    roast["events"].push_back(eventToJson(r.getEvent(i)));
+char const* mediaTypeOf(WireFormat format) {
+  switch(format) {
+  case WireFormat::Cbor:
+    return "application/cbor";
+  case WireFormat::MessagePack:
+    return "application/msgpack";
+  default:
+    return "application/json";
   }
+}
+
+static json::input_format_t inputFormatOf(WireFormat format) {
+  switch(format) {
+  case WireFormat::Cbor:
+    return json::input_format_t::cbor;
+  case WireFormat::MessagePack:
+    return json::input_format_t::msgpack;
+  default:
+    return json::input_format_t::json;
+  }
+}
 
-  for(auto i = 0U; i < r.getIngredientsCount(); i++) {
-    roast["beans"].push_back(ingredientToJson(r.getIngredient(i)));
+static void writeBinary(std::string& out, json const& j, WireFormat format) {
+  if(format == WireFormat::Cbor) {
+    json::to_cbor(j, out);
+  } else {
+    json::to_msgpack(j, out);
+  }
+}
+
+// ==================== Field selection =============================
+RoastFields RoastFields::parse(std::string const& names) {
+  static std::pair<char const*, unsigned> const known[] = {
+      {"id", Id},
+      {"beginTimestamp", BeginTimestamp},
+      {"events", events},
+      {"events.id", EventId},
+      {"events.timestamp", EventTimestamp},
+      {"events.type", EventType},
+      {"events.value", EventValue},
+      {"beans", beans},
+      {"beans.amount", BeanAmount},
+      {"beans.name", BeanName}};
+
+  unsigned selected = 0;
+  std::stringstream stream{names};
+  std::string name;
+  while(std::getline(stream, name, ',')) {
+    auto field = std::find_if(std::begin(known), std::end(known),
+                              [&name](auto const& entry) { return name == entry.first; });
+    if(field == std::end(known)) {
+      throw RoastyServerException{"Unknown field " + name, 400};
+    }
+    selected |= field->second;
+  }
+  if(selected == 0) {
+    throw RoastyServerException{"No fields selected", 400};
+  }
+  return RoastFields{selected};
+}
+
+// ==================== Json tree =============================
+json roastToJson(const Roast& r, RoastFields const& fields) {
+  json roast = json::object();
+  if(fields.has(RoastFields::Id)) {
+    roast["id"] = r.getId();
+  }
+  if(fields.has(RoastFields::BeginTimestamp)) {
+    roast["beginTimestamp"] = r.getTimestamp();
+  }
+
+  if(fields.has(RoastFields::events)) {
+    for(auto& event : r.getEvents()) {
+      roast["events"].push_back(eventToJson(event, fields));
+    }
+  }
+
+  if(fields.has(RoastFields::beans)) {
+    for(auto i = 0; i < r.getIngredientsCount(); i++) {
+      roast["beans"].push_back(ingredientToJson(r.getIngredient(i), fields));
+    }
   }
 
   return roast;
@@ -42,27 +140,32 @@ Roast jsonToRoast(json& j) {
     auto roast = Roast{j["id"].get<long>(), j["beginTimestamp"].get<long>()};
 
     for(auto& event : j["events"]) {
-      roast.addEvent(*jsonToEvent(event));
+      std::unique_ptr<Event> parsed{jsonToEvent(event)};
+      roast.addEvent(std::move(*parsed));
     }
 
     for(auto& blend : j["beans"]) {
-      roast.addIngredient(*jsonToIngredient(blend));
+      std::unique_ptr<Ingredient> parsed{jsonToIngredient(blend)};
+      roast.addIngredient(*parsed);
     }
 
     return roast;
   });
 }
 
-json eventToJson(const Event& e) {
-  // clang-format off
-  json j{
-    {"id", e.getTimestamp()},
-    {"timestamp", e.getTimestamp()},
-    {"type", e.getType()}
-  };
-  // clang-format on
+json eventToJson(const Event& e, RoastFields const& fields) {
+  json j = json::object();
+  if(fields.has(RoastFields::EventId)) {
+    j["id"] = e.getTimestamp();
+  }
+  if(fields.has(RoastFields::EventTimestamp)) {
+    j["timestamp"] = e.getTimestamp();
+  }
+  if(fields.has(RoastFields::EventType)) {
+    j["type"] = e.getType();
+  }
 
-  if(e.hasValue()) {
+  if(e.hasValue() && fields.has(RoastFields::EventValue)) {
     j["value"] = e.getValue()->getValue();
   }
 
@@ -71,29 +174,698 @@ json eventToJson(const Event& e) {
 
 Event* jsonToEvent(json& j) {
   return parseWithErrorHandling<Event*>([&] {
-    EventValue* eventValue = nullptr;
+    auto type = j["type"].get<std::string>();
+    auto timestamp = j["timestamp"].get<long>();
 
     if(!j["value"].empty()) {
-      auto value = j["value"].get<long>();
-      eventValue = new EventValue(value);
+      return new Event{type, timestamp, j["value"].get<int>()};
     }
-    auto type = j["type"].get<std::string>();
-    auto timestamp = j["timestamp"].get<long>();
-    return new Event{type, timestamp, eventValue};
+    return new Event{type, timestamp};
   });
 }
 
-nlohmann::json ingredientToJson(const Ingredient& e) {
-  // clang-format off
-  return json{
-    {"name", e.getBean().getName()},
-    {"amount", e.getAmount()}
-  };
-  // clang-format on
+nlohmann::json ingredientToJson(const Ingredient& e, RoastFields const& fields) {
+  json j = json::object();
+  if(fields.has(RoastFields::BeanName)) {
+    j["name"] = e.getBean().getName();
+  }
+  if(fields.has(RoastFields::BeanAmount)) {
+    j["amount"] = e.getAmount();
+  }
+  return j;
 }
 
 Ingredient* jsonToIngredient(nlohmann::json& j) {
   return parseWithErrorHandling<Ingredient*>([&] {
-    return new Ingredient{*(new Bean(j["name"].get<std::string>())), j["amount"].get<int>()};
+    return new Ingredient{Bean{j["name"].get<std::string>()}, j["amount"].get<int>()};
+  });
+}
+
+// ==================== SAX parser =============================
+namespace {
+
+// Collects the fields of roasts, events and ingredients while the parser walks the document and
+// builds each object as soon as it is closed. Unknown keys are skipped, a missing or mistyped
+// field is rejected just like get<>() on the json tree would reject it.
+class ModelSaxHandler : public json::json_sax_t {
+public:
+  enum class Frame { Roasts, Roast, Events, Beans, Event, Ingredient, Skipped };
+
+  explicit ModelSaxHandler(Frame root) : root(root) {}
+
+  std::vector<Roast> roasts;
+  std::vector<Event> events;
+  std::vector<Ingredient> ingredients;
+
+  bool null() override {
+    if(!inObject()) {
+      return scalar();
+    }
+    auto frame = frames.back();
+    if(frame == Frame::Roast && currentKey == "id") {
+      roast.id.reset();
+    } else if(frame == Frame::Roast && currentKey == "beginTimestamp") {
+      roast.beginTimestamp.reset();
+    } else if(frame == Frame::Roast && currentKey == "events") {
+      roast.events.clear();
+    } else if(frame == Frame::Roast && currentKey == "beans") {
+      roast.ingredients.clear();
+    } else if(frame == Frame::Event && currentKey == "timestamp") {
+      event.timestamp.reset();
+    } else if(frame == Frame::Event && currentKey == "type") {
+      event.type.reset();
+    } else if(frame == Frame::Event && currentKey == "value") {
+      event.value.reset();
+    } else if(frame == Frame::Ingredient && currentKey == "name") {
+      ingredient.name.reset();
+    } else if(frame == Frame::Ingredient && currentKey == "amount") {
+      ingredient.amount.reset();
+    }
+    return true;
+  }
+
+  // get<long>() rejects a boolean while get<int>() converts it, so only value and amount take one
+  bool boolean(bool value) override {
+    if(inObject()) {
+      auto frame = frames.back();
+      if((frame == Frame::Roast && (currentKey == "id" || currentKey == "beginTimestamp")) ||
+         (frame == Frame::Event && currentKey == "timestamp")) {
+        reject("Field " + currentKey + " must not be a boolean");
+      }
+    }
+    return number(value);
+  }
+  bool number_integer(number_integer_t value) override { return number(static_cast<long>(value)); }
+  bool number_unsigned(number_unsigned_t value) override {
+    return number(static_cast<long>(value));
+  }
+  bool number_float(number_float_t value, string_t const& /*text*/) override {
+    return number(static_cast<long>(value));
+  }
+
+  bool string(string_t& value) override {
+    if(!inObject()) {
+      return scalar();
+    }
+    auto frame = frames.back();
+    if(frame == Frame::Event && currentKey == "type") {
+      event.type = std::move(value);
+    } else if(frame == Frame::Ingredient && currentKey == "name") {
+      ingredient.name = std::move(value);
+    } else if(isKnownField(frame, currentKey)) {
+      reject("Field " + currentKey + " must not be a string");
+    }
+    return true;
+  }
+
+  bool binary(binary_t& /*value*/) override { return scalar(); }
+
+  bool key(string_t& value) override {
+    currentKey = std::move(value);
+    return true;
+  }
+
+  bool start_object(std::size_t /*elements*/) override {
+    if(frames.empty()) {
+      if(root == Frame::Roasts || root == Frame::Events) {
+        reject("Expected a list");
+      }
+      frames.push_back(root);
+    } else if(frames.back() == Frame::Roasts) {
+      frames.push_back(Frame::Roast);
+    } else if(frames.back() == Frame::Events) {
+      frames.push_back(Frame::Event);
+    } else if(frames.back() == Frame::Beans) {
+      frames.push_back(Frame::Ingredient);
+    } else {
+      nested();
+    }
+    return true;
+  }
+
+  bool end_object() override {
+    auto frame = frames.back();
+    frames.pop_back();
+
+    if(frame == Frame::Roast) {
+      roasts.push_back(buildRoast());
+    } else if(frame == Frame::Event) {
+      // Events of a roast sit below its frame, top level events below none or the list alone
+      (frames.size() > 1 ? roast.events : events).push_back(buildEvent());
+    } else if(frame == Frame::Ingredient) {
+      (frames.empty() ? ingredients : roast.ingredients).push_back(buildIngredient());
+    }
+    return true;
+  }
+
+  bool start_array(std::size_t /*elements*/) override {
+    if(frames.empty()) {
+      if(root != Frame::Roasts && root != Frame::Events) {
+        reject("Expected an object");
+      }
+      frames.push_back(root);
+    } else if(frames.back() == Frame::Roast && currentKey == "events") {
+      roast.events.clear();
+      frames.push_back(Frame::Events);
+    } else if(frames.back() == Frame::Roast && currentKey == "beans") {
+      roast.ingredients.clear();
+      frames.push_back(Frame::Beans);
+    } else {
+      nested();
+    }
+    return true;
+  }
+
+  bool end_array() override {
+    frames.pop_back();
+    return true;
+  }
+
+  bool parse_error(std::size_t /*position*/, std::string const& /*token*/,
+                   nlohmann::detail::exception const& e) override {
+    reject(e.what());
+    return false;
+  }
+
+private:
+  Frame root;
+  std::vector<Frame> frames;
+  std::string currentKey;
+
+  struct {
+    std::optional<long> id;
+    std::optional<long> beginTimestamp;
+    std::vector<Event> events;
+    std::vector<Ingredient> ingredients;
+  } roast;
+
+  struct {
+    std::optional<long> timestamp;
+    std::optional<std::string> type;
+    std::optional<int> value;
+  } event;
+
+  struct {
+    std::optional<std::string> name;
+    std::optional<int> amount;
+  } ingredient;
+
+  [[noreturn]] static void reject(std::string const& reason) {
+    throw RoastyServerException{reason, 400};
+  }
+
+  static bool isKnownField(Frame frame, std::string const& field) {
+    switch(frame) {
+    case Frame::Roast:
+      return field == "id" || field == "beginTimestamp" || field == "events" || field == "beans";
+    case Frame::Event:
+      return field == "timestamp" || field == "type" || field == "value";
+    case Frame::Ingredient:
+      return field == "name" || field == "amount";
+    default:
+      return false;
+    }
+  }
+
+  bool inObject() const {
+    return !frames.empty() && (frames.back() == Frame::Roast || frames.back() == Frame::Event ||
+                                frames.back() == Frame::Ingredient);
+  }
+
+  // A scalar outside of any object is only fine inside a skipped value
+  bool scalar() {
+    if(frames.empty() || frames.back() != Frame::Skipped) {
+      reject("Unexpected value");
+    }
+    return true;
+  }
+
+  // An object or array nested where none is expected is skipped if its key is unknown
+  void nested() {
+    auto frame = frames.back();
+    if(frame != Frame::Skipped && (!inObject() || isKnownField(frame, currentKey))) {
+      reject("Unexpected nested value");
+    }
+    frames.push_back(Frame::Skipped);
+  }
+
+  bool number(long value) {
+    if(!inObject()) {
+      return scalar();
+    }
+    auto frame = frames.back();
+    if(frame == Frame::Roast && currentKey == "id") {
+      roast.id = value;
+    } else if(frame == Frame::Roast && currentKey == "beginTimestamp") {
+      roast.beginTimestamp = value;
+    } else if(frame == Frame::Event && currentKey == "timestamp") {
+      event.timestamp = value;
+    } else if(frame == Frame::Event && currentKey == "value") {
+      event.value = static_cast<int>(value);
+    } else if(frame == Frame::Ingredient && currentKey == "amount") {
+      ingredient.amount = static_cast<int>(value);
+    } else if(isKnownField(frame, currentKey)) {
+      reject("Field " + currentKey + " must not be a number");
+    }
+    return true;
+  }
+
+  Roast buildRoast() {
+    if(!roast.id || !roast.beginTimestamp) {
+      reject("Roast needs an id and a beginTimestamp");
+    }
+    Roast r{*roast.id, *roast.beginTimestamp};
+    for(auto& e : roast.events) {
+      r.addEvent(std::move(e));
+    }
+    for(auto& i : roast.ingredients) {
+      r.addIngredient(i);
+    }
+    roast = {};
+    return r;
+  }
+
+  Event buildEvent() {
+    if(!event.timestamp || !event.type) {
+      reject("Event needs a timestamp and a type");
+    }
+    auto e = event.value ? Event{*event.type, *event.timestamp, *event.value}
+                         : Event{*event.type, *event.timestamp};
+    event = {};
+    return e;
+  }
+
+  Ingredient buildIngredient() {
+    if(!ingredient.name || !ingredient.amount) {
+      reject("Ingredient needs a name and an amount");
+    }
+    Ingredient i{Bean{*ingredient.name}, *ingredient.amount};
+    ingredient = {};
+    return i;
+  }
+};
+
+template <typename Input>
+ModelSaxHandler parseModel(Input&& input, ModelSaxHandler::Frame root,
+                           WireFormat format = WireFormat::Json) {
+  ModelSaxHandler handler{root};
+  json::sax_parse(std::forward<Input>(input), &handler, inputFormatOf(format));
+  return handler;
+}
+
+} // namespace
+
+Roast parseRoast(std::string const& text, WireFormat format) {
+  return parseWithErrorHandling<Roast>([&] {
+    return std::move(parseModel(text, ModelSaxHandler::Frame::Roast, format).roasts.front());
   });
 }
+
+std::vector<Roast> parseRoasts(std::istream& input) {
+  return parseWithErrorHandling<std::vector<Roast>>(
+      [&] { return std::move(parseModel(input, ModelSaxHandler::Frame::Roasts).roasts); });
+}
+
+std::vector<Event> parseEvents(std::string const& text, WireFormat format) {
+  return parseWithErrorHandling<std::vector<Event>>(
+      [&] { return std::move(parseModel(text, ModelSaxHandler::Frame::Events, format).events); });
+}
+
+std::vector<Event> parseEventLines(std::string const& text) {
+  return parseWithErrorHandling<std::vector<Event>>([&] {
+    std::vector<Event> events;
+    std::stringstream input{text};
+    std::string line;
+    while(std::getline(input, line)) {
+      if(line.find_first_not_of(" \t\r") != std::string::npos) {
+        events.push_back(std::move(parseModel(line, ModelSaxHandler::Frame::Event).events.front()));
+      }
+    }
+    return events;
+  });
+}
+
+Event parseEvent(std::string const& text, WireFormat format) {
+  return parseWithErrorHandling<Event>([&] {
+    return std::move(parseModel(text, ModelSaxHandler::Frame::Event, format).events.front());
+  });
+}
+
+Ingredient parseIngredient(std::string const& text, WireFormat format) {
+  return parseWithErrorHandling<Ingredient>([&] {
+    auto handler = parseModel(text, ModelSaxHandler::Frame::Ingredient, format);
+    return std::move(handler.ingredients.front());
+  });
+}
+
+// ==================== Streaming writer =============================
+// Keys are written in the order nlohmann::json sorts them and optional fields are left out
+// exactly where the *ToJson functions leave them out, so both produce identical text.
+
+static void writeNumber(std::string& out, long value) {
+  char digits[24];
+  auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+  out.append(digits, result.ptr);
+}
+
+static void writeString(std::string& out, std::string const& value) {
+  static char const hex[] = "0123456789abcdef";
+
+  out.push_back('"');
+  for(auto c : value) {
+    switch(c) {
+    case '"':
+      out.append("\\\"");
+      break;
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\b':
+      out.append("\\b");
+      break;
+    case '\f':
+      out.append("\\f");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\r':
+      out.append("\\r");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default:
+      if(static_cast<unsigned char>(c) < 0x20) {
+        out.append("\\u00");
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0xf]);
+      } else {
+        out.push_back(c);
+      }
+    }
+  }
+  out.push_back('"');
+}
+
+// Separates the members of an object, whichever of them are selected
+class MemberWriter {
+public:
+  explicit MemberWriter(std::string& out) : out(out) { out.push_back('{'); }
+  ~MemberWriter() { out.push_back('}'); }
+
+  std::string& key(char const* name) {
+    if(!first) {
+      out.push_back(',');
+    }
+    first = false;
+    out.push_back('"');
+    out.append(name);
+    out.append("\":");
+    return out;
+  }
+
+private:
+  std::string& out;
+  bool first = true;
+};
+
+void writeRoastJson(std::string& out, const Roast& r, RoastFields const& fields) {
+  MemberWriter members{out};
+
+  if(r.getIngredientsCount() > 0 && fields.has(RoastFields::beans)) {
+    members.key("beans").push_back('[');
+    for(auto i = 0; i < r.getIngredientsCount(); i++) {
+      if(i > 0) {
+        out.push_back(',');
+      }
+      writeIngredientJson(out, r.getIngredient(i), fields);
+    }
+    out.push_back(']');
+  }
+
+  if(fields.has(RoastFields::BeginTimestamp)) {
+    writeNumber(members.key("beginTimestamp"), r.getTimestamp());
+  }
+
+  if(r.getEventCount() > 0 && fields.has(RoastFields::events)) {
+    members.key("events").push_back('[');
+    auto first = true;
+    for(auto& event : r.getEvents()) {
+      if(!first) {
+        out.push_back(',');
+      }
+      first = false;
+      writeEventJson(out, event, fields);
+    }
+    out.push_back(']');
+  }
+
+  if(fields.has(RoastFields::Id)) {
+    writeNumber(members.key("id"), r.getId());
+  }
+}
+
+void writeRoastsJson(std::string& out, std::vector<Roast> const& roasts) {
+  writeRoasts(out, roasts, WireFormat::Json);
+}
+
+void writeEventJson(std::string& out, const Event& e, RoastFields const& fields) {
+  MemberWriter members{out};
+
+  if(fields.has(RoastFields::EventId)) {
+    writeNumber(members.key("id"), e.getTimestamp());
+  }
+  if(fields.has(RoastFields::EventTimestamp)) {
+    writeNumber(members.key("timestamp"), e.getTimestamp());
+  }
+  if(fields.has(RoastFields::EventType)) {
+    writeString(members.key("type"), e.getType());
+  }
+  if(e.hasValue() && fields.has(RoastFields::EventValue)) {
+    writeNumber(members.key("value"), e.getValue()->getValue());
+  }
+}
+
+void writeIngredientJson(std::string& out, const Ingredient& e, RoastFields const& fields) {
+  MemberWriter members{out};
+
+  if(fields.has(RoastFields::BeanAmount)) {
+    writeNumber(members.key("amount"), e.getAmount());
+  }
+  if(fields.has(RoastFields::BeanName)) {
+    writeString(members.key("name"), e.getBean().getName());
+  }
+}
+
+void writeRoast(std::string& out, const Roast& r, WireFormat format, RoastFields const& fields) {
+  if(format == WireFormat::Json) {
+    writeRoastJson(out, r, fields);
+  } else {
+    writeBinary(out, roastToJson(r, fields), format);
+  }
+}
+
+void writeRoasts(std::string& out, std::vector<Roast> const& roasts, WireFormat format,
+                 RoastFields const& fields) {
+  writeRoastsBegin(out, roasts.size(), format);
+  for(auto i = 0U; i < roasts.size(); i++) {
+    writeRoastsElement(out, roasts[i], i, format, fields);
+  }
+  writeRoastsEnd(out, roasts.size(), format);
+}
+
+void writeRoasts(std::string& out, std::vector<std::shared_ptr<Roast const>> const& roasts,
+                 WireFormat format, RoastFields const& fields) {
+  writeRoastsBegin(out, roasts.size(), format);
+  for(auto i = 0U; i < roasts.size(); i++) {
+    writeRoastsElement(out, *roasts[i], i, format, fields);
+  }
+  writeRoastsEnd(out, roasts.size(), format);
+}
+
+// Appends value big endian in the given number of bytes
+static void writeBigEndian(std::string& out, std::uint64_t value, int bytes) {
+  for(auto shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>((value >> shift) & 0xff));
+  }
+}
+
+// The array header is written by hand with the same length encoding nlohmann uses, the roasts
+// themselves are encoded one by one as they are appended
+void writeRoastsBegin(std::string& out, size_t count, WireFormat format) {
+  if(count == 0) {
+    // An empty listing has always been sent as null
+    if(format == WireFormat::Json) {
+      out.append("null");
+    } else {
+      writeBinary(out, json{}, format);
+    }
+    return;
+  }
+
+  if(format == WireFormat::Json) {
+    out.push_back('[');
+  } else if(format == WireFormat::Cbor) {
+    if(count < 24) {
+      out.push_back(static_cast<char>(0x80 + count));
+    } else if(count <= 0xff) {
+      out.push_back(static_cast<char>(0x98));
+      writeBigEndian(out, count, 1);
+    } else if(count <= 0xffff) {
+      out.push_back(static_cast<char>(0x99));
+      writeBigEndian(out, count, 2);
+    } else if(count <= 0xffffffff) {
+      out.push_back(static_cast<char>(0x9a));
+      writeBigEndian(out, count, 4);
+    } else {
+      out.push_back(static_cast<char>(0x9b));
+      writeBigEndian(out, count, 8);
+    }
+  } else {
+    if(count < 16) {
+      out.push_back(static_cast<char>(0x90 | count));
+    } else if(count <= 0xffff) {
+      out.push_back(static_cast<char>(0xdc));
+      writeBigEndian(out, count, 2);
+    } else {
+      out.push_back(static_cast<char>(0xdd));
+      writeBigEndian(out, count, 4);
+    }
+  }
+}
+
+void writeRoastsElement(std::string& out, const Roast& r, size_t index, WireFormat format,
+                        RoastFields const& fields) {
+  if(format == WireFormat::Json) {
+    if(index > 0) {
+      out.push_back(',');
+    }
+    writeRoastJson(out, r, fields);
+  } else {
+    writeBinary(out, roastToJson(r, fields), format);
+  }
+}
+
+void writeRoastsEnd(std::string& out, size_t count, WireFormat format) {
+  if(count > 0 && format == WireFormat::Json) {
+    out.push_back(']');
+  }
+}
+
+void writeEvent(std::string& out, const Event& e, WireFormat format) {
+  if(format == WireFormat::Json) {
+    writeEventJson(out, e);
+  } else {
+    writeBinary(out, eventToJson(e), format);
+  }
+}
+
+void writeIngredient(std::string& out, const Ingredient& e, WireFormat format) {
+  if(format == WireFormat::Json) {
+    writeIngredientJson(out, e);
+  } else {
+    writeBinary(out, ingredientToJson(e), format);
+  }
+}
+
+// Charts ask for a few hundred windows at most, so the json tree is cheap enough here
+void writeEventBuckets(std::string& out, std::vector<EventBucket> const& buckets,
+                       unsigned aggregates, WireFormat format) {
+  json j = json::array();
+  for(auto const& bucket : buckets) {
+    json b{{"start", bucket.start}};
+    if(aggregates & EventAggregate::Count) {
+      b["count"] = bucket.count;
+    }
+    if(aggregates & EventAggregate::Min) {
+      b["min"] = bucket.min;
+    }
+    if(aggregates & EventAggregate::Max) {
+      b["max"] = bucket.max;
+    }
+    if(aggregates & EventAggregate::Avg) {
+      b["avg"] = bucket.avg;
+    }
+    j.push_back(std::move(b));
+  }
+
+  if(format == WireFormat::Json) {
+    out += j.dump();
+  } else {
+    writeBinary(out, j, format);
+  }
+}
+
+void writeRoastMetrics(std::string& out, RoastMetrics const& metrics, WireFormat format) {
+  json phases = json::object();
+  auto phase = [&phases](char const* name, std::optional<long> const& duration) {
+    if(duration) {
+      phases[name] = *duration;
+    }
+  };
+  phase("drying", metrics.dryingTime);
+  phase("maillard", metrics.maillardTime);
+  phase("development", metrics.developmentTime);
+  phase("total", metrics.totalTime);
+
+  json temperature{{"readings", metrics.readingCount}};
+  if(metrics.readingCount > 0) {
+    temperature["min"] = *metrics.minTemperature;
+    temperature["max"] = *metrics.maxTemperature;
+    temperature["mean"] = *metrics.meanTemperature;
+  }
+
+  json rateOfRise = json::array();
+  for(auto const& point : metrics.rateOfRise) {
+    rateOfRise.push_back({{"timestamp", point.timestamp}, {"value", point.value}});
+  }
+
+  json j{{"phases", std::move(phases)},
+         {"temperature", std::move(temperature)},
+         {"rateOfRise", std::move(rateOfRise)}};
+  if(metrics.developmentRatio) {
+    j["developmentRatio"] = *metrics.developmentRatio;
+  }
+
+  if(format == WireFormat::Json) {
+    out += j.dump();
+  } else {
+    writeBinary(out, j, format);
+  }
+}
+
+void writeSimilarRoasts(std::string& out, std::vector<SimilarRoast> const& roasts,
+                        WireFormat format) {
+  json j = json::array();
+  for(auto const& roast : roasts) {
+    j.push_back({{"id", roast.id}, {"distance", roast.distance}});
+  }
+
+  if(format == WireFormat::Json) {
+    out += j.dump();
+  } else {
+    writeBinary(out, j, format);
+  }
+}
+
+void writeBeanUsage(std::string& out, std::vector<BeanUsageReport> const& reports,
+                    WireFormat format) {
+  json beans = json::array();
+  for(auto const& report : reports) {
+    json bean{{"name", report.name},
+              {"amount", report.total.amount},
+              {"roasts", report.total.roasts}};
+    for(auto const& [day, usage] : report.days) {
+      bean["days"].push_back({{"day", day}, {"amount", usage.amount}, {"roasts", usage.roasts}});
+    }
+    beans.push_back(std::move(bean));
+  }
+
+  json j{{"beans", std::move(beans)}};
+  if(format == WireFormat::Json) {
+    out += j.dump();
+  } else {
+    writeBinary(out, j, format);
+  }
+}
@@ -1,13 +1,101 @@
 #pragma once
 
+#include "BeanUsage.hpp"
+#include "EventAggregation.hpp"
 #include "Model/RoastyModel.hpp"
+#include "RoastMetrics.hpp"
+#include "RoastSimilarity.hpp"
+#include <istream>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
 
-nlohmann::json roastToJson(const Roast& r);
+// Encodings a request or response body can use. The binary formats carry the same document
+// as the json text, encoded as CBOR or MessagePack.
+enum class WireFormat { Json, Cbor, MessagePack };
+
+// Picks the format named in an Accept or Content-Type header value, json if none is named
+WireFormat wireFormatOf(std::string const& mediaTypes);
+char const* mediaTypeOf(WireFormat format);
+
+// Fields of a roast a response is limited to. Named as in the json, events and beans select every
+// field of their elements, "events.type" or "beans.name" a single one.
+class RoastFields {
+public:
+  enum Field : unsigned {
+    Id = 1 << 0,
+    BeginTimestamp = 1 << 1,
+    EventId = 1 << 2,
+    EventTimestamp = 1 << 3,
+    EventType = 1 << 4,
+    EventValue = 1 << 5,
+    BeanAmount = 1 << 6,
+    BeanName = 1 << 7
+  };
+  static unsigned const events = EventId | EventTimestamp | EventType | EventValue;
+  static unsigned const beans = BeanAmount | BeanName;
+  static unsigned const all = Id | BeginTimestamp | events | beans;
+
+  RoastFields() = default;
+  explicit RoastFields(unsigned selected) : selected(selected) {}
+
+  // Parses a comma separated list of field names
+  static RoastFields parse(std::string const& names);
+
+  bool has(unsigned fields) const { return (selected & fields) != 0; }
+  unsigned getSelected() const { return selected; }
+
+private:
+  unsigned selected = all;
+};
+
+nlohmann::json roastToJson(const Roast& r, RoastFields const& fields = {});
 Roast jsonToRoast(nlohmann::json& j);
 
-nlohmann::json eventToJson(const Event& e);
+nlohmann::json eventToJson(const Event& e, RoastFields const& fields = {});
 Event* jsonToEvent(nlohmann::json& j);
 
-nlohmann::json ingredientToJson(const Ingredient& e);
+nlohmann::json ingredientToJson(const Ingredient& e, RoastFields const& fields = {});
 Ingredient* jsonToIngredient(nlohmann::json& j);
+
+// Parse request bodies and database files straight into the model without building a json tree.
+// Accept the same documents as the json functions above and report errors the same way.
+Roast parseRoast(std::string const& text, WireFormat format = WireFormat::Json);
+std::vector<Roast> parseRoasts(std::istream& input);
+Event parseEvent(std::string const& text, WireFormat format = WireFormat::Json);
+// A list of events, or newline delimited json with one event per line
+std::vector<Event> parseEvents(std::string const& text, WireFormat format = WireFormat::Json);
+std::vector<Event> parseEventLines(std::string const& text);
+Ingredient parseIngredient(std::string const& text, WireFormat format = WireFormat::Json);
+
+// Append exactly the text dump() produces for the matching json above, without building the tree.
+// Fields that are not selected are left out and events or beans not selected are never visited.
+void writeRoastJson(std::string& out, const Roast& r, RoastFields const& fields = {});
+void writeRoastsJson(std::string& out, std::vector<Roast> const& roasts);
+void writeEventJson(std::string& out, const Event& e, RoastFields const& fields = {});
+void writeIngredientJson(std::string& out, const Ingredient& e, RoastFields const& fields = {});
+
+// Append a response body in the given format. Json is streamed by the writers above, the binary
+// formats are encoded from the json tree.
+void writeRoast(std::string& out, const Roast& r, WireFormat format,
+                RoastFields const& fields = {});
+void writeRoasts(std::string& out, std::vector<Roast> const& roasts, WireFormat format,
+                 RoastFields const& fields = {});
+void writeRoasts(std::string& out, std::vector<std::shared_ptr<Roast const>> const& roasts,
+                 WireFormat format, RoastFields const& fields = {});
+// The pieces writeRoasts is made of, so a long listing can be encoded a few roasts at a time
+void writeRoastsBegin(std::string& out, size_t count, WireFormat format);
+void writeRoastsElement(std::string& out, const Roast& r, size_t index, WireFormat format,
+                        RoastFields const& fields = {});
+void writeRoastsEnd(std::string& out, size_t count, WireFormat format);
+void writeEvent(std::string& out, const Event& e, WireFormat format);
+void writeIngredient(std::string& out, const Ingredient& e, WireFormat format);
+// Windows of aggregated events, each with its start and the aggregates selected
+void writeEventBuckets(std::string& out, std::vector<EventBucket> const& buckets,
+                       unsigned aggregates, WireFormat format);
+void writeRoastMetrics(std::string& out, RoastMetrics const& metrics, WireFormat format);
+void writeSimilarRoasts(std::string& out, std::vector<SimilarRoast> const& roasts,
+                        WireFormat format);
+void writeBeanUsage(std::string& out, std::vector<BeanUsageReport> const& reports,
+                    WireFormat format);
@@ -0,0 +1,93 @@
+#include "Compression.hpp"
+#include "RoastyServerException.hpp"
+#include <cstdlib>
+#include <sstream>
+#include <zlib.h>
+
+ContentEncoding acceptedEncoding(std::string const& acceptEncoding) {
+  auto gzip = false;
+  auto deflate = false;
+
+  std::stringstream stream{acceptEncoding};
+  std::string coding;
+  while(std::getline(stream, coding, ',')) {
+    auto parameters = coding.find(';');
+    auto name = coding.substr(0, parameters);
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+
+    // A coding listed with q=0 is one the client refuses
+    if(parameters != std::string::npos) {
+      auto quality = coding.find("q=", parameters);
+      if(quality != std::string::npos && std::strtod(coding.c_str() + quality + 2, nullptr) == 0) {
+        continue;
+      }
+    }
+
+    gzip = gzip || name == "gzip" || name == "*";
+    deflate = deflate || name == "deflate";
+  }
+
+  return gzip ? ContentEncoding::Gzip : deflate ? ContentEncoding::Deflate : ContentEncoding::Identity;
+}
+
+char const* contentEncodingName(ContentEncoding encoding) {
+  switch(encoding) {
+  case ContentEncoding::Gzip:
+    return "gzip";
+  case ContentEncoding::Deflate:
+    return "deflate";
+  default:
+    return "identity";
+  }
+}
+
+std::string compress(std::string const& body, ContentEncoding encoding) {
+  std::string out;
+  StreamCompressor{encoding}.finish(body, out);
+  return out;
+}
+
+// ==================== Streams =============================
+StreamCompressor::StreamCompressor(ContentEncoding encoding) : stream(std::make_unique<z_stream>()) {
+  // Window bits of 15 write a zlib stream (HTTP deflate), adding 16 writes a gzip stream
+  auto windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+
+  if(deflateInit2(stream.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8,
+                  Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw RoastyServerException{"Error initialising compression", 500};
+  }
+}
+
+StreamCompressor::~StreamCompressor() { deflateEnd(stream.get()); }
+
+void StreamCompressor::write(std::string const& data, std::string& out) {
+  run(data, Z_SYNC_FLUSH, out);
+}
+
+void StreamCompressor::finish(std::string const& data, std::string& out) {
+  run(data, Z_FINISH, out);
+}
+
+void StreamCompressor::run(std::string const& data, int flush, std::string& out) {
+  size_t const step = 16 * 1024;
+
+  stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream->avail_in = data.size();
+
+  // Deflate until all input is consumed and, when finishing, the stream is closed
+  auto result = Z_OK;
+  do {
+    auto offset = out.size();
+    out.resize(offset + step);
+    stream->next_out = reinterpret_cast<Bytef*>(&out[offset]);
+    stream->avail_out = step;
+
+    result = deflate(stream.get(), flush);
+    out.resize(offset + step - stream->avail_out);
+
+    if(result == Z_STREAM_ERROR) {
+      throw RoastyServerException{"Error compressing response", 500};
+    }
+  } while(stream->avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+struct z_stream_s;
+
+enum class ContentEncoding { Identity, Gzip, Deflate };
+
+// Bodies smaller than this gain too little from compression to be worth it
+size_t const minimumCompressedSize = 1024;
+
+// Picks the encoding from an Accept-Encoding header value, gzip is preferred over deflate
+ContentEncoding acceptedEncoding(std::string const& acceptEncoding);
+char const* contentEncodingName(ContentEncoding encoding);
+
+// Compresses body in the given encoding, which must not be Identity
+std::string compress(std::string const& body, ContentEncoding encoding);
+
+// Compresses a body piece by piece for responses that are streamed
+class StreamCompressor {
+public:
+  explicit StreamCompressor(ContentEncoding encoding);
+  StreamCompressor(StreamCompressor const& other) = delete;
+  StreamCompressor& operator=(StreamCompressor const& other) = delete;
+  ~StreamCompressor();
+
+  // Appends data compressed to out, flushed so the receiver can decode everything written so far
+  void write(std::string const& data, std::string& out);
+  // Appends the last piece of data compressed to out and ends the stream
+  void finish(std::string const& data, std::string& out);
+
+private:
+  std::unique_ptr<z_stream_s> stream;
+
+  void run(std::string const& data, int flush, std::string& out);
+};
@@ -0,0 +1,56 @@
+#include "ResponseCache.hpp"
+#include <utility>
+
+ResponseCache::Body ResponseCache::get(std::string const& key, unsigned long version,
+                                       Renderer const& render) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto entry = entries.find(key);
+    if(entry != entries.end() && entry->second.version == version) {
+      recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, entry->second.recent);
+      return entry->second.body;
+    }
+  }
+
+  // Rendering can be expensive, so other requests are not held up while it runs
+  std::string out;
+  render(out);
+  auto body = std::make_shared<std::string const>(std::move(out));
+
+  std::lock_guard<std::mutex> lock{mutex};
+  store(key, version, body);
+  return body;
+}
+
+size_t ResponseCache::getSize() const {
+  std::lock_guard<std::mutex> lock{mutex};
+  return bytes;
+}
+
+void ResponseCache::store(std::string const& key, unsigned long version, Body const& body) {
+  auto entry = entries.find(key);
+  if(entry != entries.end()) {
+    // Another request may have stored a body for a newer version in the meantime
+    if(entry->second.version > version) {
+      return;
+    }
+    erase(entry);
+  }
+  if(body->size() > maxBytes) {
+    return;
+  }
+
+  recentlyUsed.push_front(key);
+  entries.emplace(key, Entry{version, body, recentlyUsed.begin()});
+  bytes += body->size();
+
+  while(bytes > maxBytes) {
+    erase(entries.find(recentlyUsed.back()));
+  }
+}
+
+void ResponseCache::erase(std::unordered_map<std::string, Entry>::iterator entry) {
+  bytes -= entry->second.body->size();
+  recentlyUsed.erase(entry->second.recent);
+  entries.erase(entry);
+}
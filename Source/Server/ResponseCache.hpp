@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Encoded bodies of the read endpoints, keyed by resource and wire format. A body is stored with
+// the version of the data it was rendered from and only served while the caller still asks for
+// that version. The least recently used bodies are dropped once the cache outgrows its budget.
+class ResponseCache {
+public:
+  using Body = std::shared_ptr<std::string const>;
+  using Renderer = std::function<void(std::string& out)>;
+
+  explicit ResponseCache(size_t maxBytes = 64 * 1024 * 1024) : maxBytes(maxBytes) {}
+
+  // Returns the body stored for key at version, rendering and storing it on a miss
+  Body get(std::string const& key, unsigned long version, Renderer const& render);
+
+  size_t getSize() const;
+
+private:
+  struct Entry {
+    unsigned long version;
+    Body body;
+    std::list<std::string>::iterator recent;
+  };
+
+  mutable std::mutex mutex;
+  size_t const maxBytes;
+  size_t bytes = 0;
+  std::unordered_map<std::string, Entry> entries;
+  std::list<std::string> recentlyUsed; // Most recently used first
+
+  void store(std::string const& key, unsigned long version, Body const& body);
+  void erase(std::unordered_map<std::string, Entry>::iterator entry);
+};
@@ -3,13 +3,23 @@
 #include "../Serialisation.hpp"
 #include "../Storage/DiskStorage.hpp"
 #include "../Storage/MemoryStorage.hpp"
+#include "Compression.hpp"
 #include "RoastyServerException.hpp"
 #include "httplib.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace httplib;
 using json = nlohmann::json;
@@ -26,24 +36,372 @@ void handleRequestWithErrorHandling(Response& res, const std::function<void(void
   }
 }
 
+// Bodies are json unless the client names one of the binary wire formats
+WireFormat requestFormat(const Request& req) {
+  return wireFormatOf(req.get_header_value("Content-Type"));
+}
+
+WireFormat responseFormat(const Request& req, Response& res) {
+  res.set_header("Vary", "Accept");
+  return wireFormatOf(req.get_header_value("Accept"));
+}
+
+// Roast responses can be limited to some of their fields with ?fields=id,beginTimestamp
+RoastFields roastFields(const Request& req) {
+  if(!req.has_param("fields")) {
+    return {};
+  }
+  return RoastFields::parse(req.get_param_value("fields"));
+}
+
+std::string cacheKey(std::string const& resource, WireFormat format,
+                     RoastFields const& fields = {}) {
+  auto key = resource + ' ' + mediaTypeOf(format);
+  if(fields.getSelected() != RoastFields::all) {
+    key += ' ' + std::to_string(fields.getSelected());
+  }
+  return key;
+}
+
+// ETags carry the version of the data, the format it is encoded in and the fields selected
+std::string etagOf(unsigned long version, WireFormat format, RoastFields const& fields = {}) {
+  std::string mediaType = mediaTypeOf(format);
+  auto etag = std::to_string(version) + '-' + mediaType.substr(mediaType.find('/') + 1);
+  if(fields.getSelected() != RoastFields::all) {
+    etag += '-' + std::to_string(fields.getSelected());
+  }
+  return '"' + etag + '"';
+}
+
+// Splits an If-Match or If-None-Match header into its entity tags
+std::vector<std::string> entityTags(std::string const& header) {
+  std::vector<std::string> tags;
+  std::stringstream stream{header};
+  std::string tag;
+  while(std::getline(stream, tag, ',')) {
+    auto begin = tag.find_first_not_of(" \t");
+    auto end = tag.find_last_not_of(" \t");
+    if(begin != std::string::npos) {
+      tags.push_back(tag.substr(begin, end - begin + 1));
+    }
+  }
+  return tags;
+}
+
+// Answers 304 if the client already holds this version, the body is then never rendered
+bool notModified(const Request& req, Response& res, std::string const& etag) {
+  res.set_header("ETag", etag);
+  for(auto tag : entityTags(req.get_header_value("If-None-Match"))) {
+    if(tag.compare(0, 2, "W/") == 0) {
+      tag.erase(0, 2);
+    }
+    if(tag == "*" || tag == etag) {
+      res.status = 304;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Writes with an If-Match header only go ahead if the resource still has one of the versions
+// named, in any format. Weak tags never match.
+WriteCondition writeCondition(const Request& req) {
+  WriteCondition condition;
+  for(auto& tag : entityTags(req.get_header_value("If-Match"))) {
+    if(tag == "*") {
+      return {};
+    }
+    condition.conditional = true;
+    if(tag.size() > 1 && tag[0] == '"' && std::isdigit(static_cast<unsigned char>(tag[1]))) {
+      condition.versions.push_back(std::strtoul(tag.c_str() + 1, nullptr, 10));
+    }
+  }
+  return condition;
+}
+
+// Largest page a client may ask for
+size_t const maximumPageSize = 1000;
+
+long numberParameter(const Request& req, char const* name) {
+  auto value = req.get_param_value(name);
+  char* end = nullptr;
+  auto number = std::strtol(value.c_str(), &end, 10);
+  if(value.empty() || *end != '\0') {
+    throw RoastyServerException{std::string{"Invalid "} + name, Roasty<void>::errorCode};
+  }
+  return number;
+}
+
+// Cursors are opaque to clients, they hold the beginTimestamp and id of the last roast returned
+std::string cursorOf(RoastCursor const& cursor) {
+  return std::to_string(cursor.beginTimestamp) + '_' + std::to_string(cursor.id);
+}
+
+RoastCursor parseCursor(std::string const& text) {
+  char* end = nullptr;
+  RoastCursor cursor{};
+  cursor.beginTimestamp = std::strtol(text.c_str(), &end, 10);
+  if(end == text.c_str() || *end != '_') {
+    throw RoastyServerException{"Invalid cursor", Roasty<void>::errorCode};
+  }
+  auto const* id = end + 1;
+  cursor.id = std::strtol(id, &end, 10);
+  if(end == id || *end != '\0') {
+    throw RoastyServerException{"Invalid cursor", Roasty<void>::errorCode};
+  }
+  return cursor;
+}
+
+bool isPagedQuery(const Request& req) {
+  for(auto name : {"after", "limit", "from", "to", "bean"}) {
+    if(req.has_param(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+RoastFilter roastFilter(const Request& req) {
+  RoastFilter filter;
+  if(req.has_param("after")) {
+    filter.after = parseCursor(req.get_param_value("after"));
+  }
+  if(req.has_param("limit")) {
+    auto limit = numberParameter(req, "limit");
+    if(limit < 1 || static_cast<size_t>(limit) > maximumPageSize) {
+      throw RoastyServerException{"Invalid limit", Roasty<void>::errorCode};
+    }
+    filter.limit = limit;
+  }
+  if(req.has_param("from")) {
+    filter.from = numberParameter(req, "from");
+  }
+  if(req.has_param("to")) {
+    filter.to = numberParameter(req, "to");
+  }
+  if(req.has_param("bean")) {
+    filter.bean = req.get_param_value("bean");
+  }
+  return filter;
+}
+
+// Pages are cached like whole listings, the key holds every parameter that selects the page
+std::string cacheKey(RoastFilter const& filter, WireFormat format, RoastFields const& fields) {
+  std::string resource = "/roasts?limit=" + std::to_string(filter.limit);
+  if(filter.after) {
+    resource += "&after=" + cursorOf(*filter.after);
+  }
+  if(filter.from) {
+    resource += "&from=" + std::to_string(*filter.from);
+  }
+  if(filter.to) {
+    resource += "&to=" + std::to_string(*filter.to);
+  }
+  if(filter.bean) {
+    resource += "&bean=" + *filter.bean;
+  }
+  return cacheKey(resource, format, fields);
+}
+
+// Durations are given in milliseconds, like the timestamps, or with a unit: 500ms, 5s, 1m, 1h
+long durationParameter(const Request& req, char const* name) {
+  static std::pair<char const*, long> const units[] = {
+      {"", 1}, {"ms", 1}, {"s", 1000}, {"m", 60 * 1000}, {"h", 60 * 60 * 1000}};
+
+  auto value = req.get_param_value(name);
+  char* end = nullptr;
+  auto duration = std::strtol(value.c_str(), &end, 10);
+  auto unit = std::find_if(std::begin(units), std::end(units),
+                           [end](auto const& entry) { return std::strcmp(end, entry.first) == 0; });
+  if(end == value.c_str() || unit == std::end(units) || duration <= 0 ||
+     duration > LONG_MAX / unit->second) {
+    throw RoastyServerException{std::string{"Invalid "} + name, Roasty<void>::errorCode};
+  }
+  return duration * unit->second;
+}
+
+long bucketWidth(const Request& req) {
+  if(!req.has_param("bucket")) {
+    throw RoastyServerException{"No bucket width given", Roasty<void>::errorCode};
+  }
+  return durationParameter(req, "bucket");
+}
+
+// Rate of rise is smoothed over half a minute unless asked otherwise
+long smoothingWindow(const Request& req) {
+  return req.has_param("window") ? durationParameter(req, "window") : 30 * 1000;
+}
+
+unsigned eventAggregates(const Request& req) {
+  if(!req.has_param("agg")) {
+    return EventAggregate::Min | EventAggregate::Max | EventAggregate::Avg;
+  }
+  static std::pair<char const*, unsigned> const known[] = {{"count", EventAggregate::Count},
+                                                           {"min", EventAggregate::Min},
+                                                           {"max", EventAggregate::Max},
+                                                           {"avg", EventAggregate::Avg}};
+
+  unsigned aggregates = 0;
+  std::stringstream stream{req.get_param_value("agg")};
+  std::string name;
+  while(std::getline(stream, name, ',')) {
+    auto aggregate = std::find_if(std::begin(known), std::end(known),
+                                  [&name](auto const& entry) { return name == entry.first; });
+    if(aggregate == std::end(known)) {
+      throw RoastyServerException{"Unknown aggregate " + name, Roasty<void>::errorCode};
+    }
+    aggregates |= aggregate->second;
+  }
+  if(aggregates == 0) {
+    throw RoastyServerException{"No aggregates selected", Roasty<void>::errorCode};
+  }
+  return aggregates;
+}
+
+// Largest number of similar roasts a client may ask for
+size_t const maximumSimilarRoasts = 100;
+
+// Listings with more roasts than this are streamed as they are encoded rather than rendered and
+// cached whole, so memory use does not grow with the history
+size_t const streamedListingSize = 1000;
+// Roughly how much is encoded per chunk of a streamed listing
+size_t const streamedChunkSize = 64 * 1024;
+
+void streamRoasts(const Request& req, Response& res, std::shared_ptr<RoastList const> roasts,
+                  WireFormat format, RoastFields const& fields) {
+  struct ListingStream {
+    std::shared_ptr<RoastList const> roasts;
+    WireFormat format;
+    RoastFields fields;
+    std::unique_ptr<StreamCompressor> compressor;
+    size_t next = 0;
+  };
+
+  auto stream = std::make_shared<ListingStream>();
+  stream->roasts = std::move(roasts);
+  stream->format = format;
+  stream->fields = fields;
+
+  res.set_header("Vary", "Accept-Encoding");
+  auto encoding = acceptedEncoding(req.get_header_value("Accept-Encoding"));
+  if(encoding != ContentEncoding::Identity) {
+    stream->compressor = std::make_unique<StreamCompressor>(encoding);
+    res.set_header("Content-Encoding", contentEncodingName(encoding));
+  }
+
+  // Each call encodes the next few roasts of the snapshot and hands them to the socket
+  res.set_chunked_content_provider(mediaTypeOf(format), [stream](size_t /*offset*/,
+                                                                 DataSink& sink) {
+    auto& roasts = *stream->roasts;
+    std::string chunk;
+    if(stream->next == 0) {
+      writeRoastsBegin(chunk, roasts.size(), stream->format);
+    }
+    while(stream->next < roasts.size() && chunk.size() < streamedChunkSize) {
+      writeRoastsElement(chunk, *roasts[stream->next], stream->next, stream->format,
+                         stream->fields);
+      stream->next++;
+    }
+
+    auto last = stream->next == roasts.size();
+    if(last) {
+      writeRoastsEnd(chunk, roasts.size(), stream->format);
+    }
+
+    if(stream->compressor) {
+      std::string compressed;
+      if(last) {
+        stream->compressor->finish(chunk, compressed);
+      } else {
+        stream->compressor->write(chunk, compressed);
+      }
+      chunk = std::move(compressed);
+    }
+
+    sink.write(chunk.data(), chunk.size());
+    if(last) {
+      sink.done();
+    }
+    return true;
+  });
+}
+
+template <typename RoastyImplementation>
+void RoastyServer<RoastyImplementation>::sendBody(const Request& req, Response& res,
+                                                  std::string const& key, unsigned long version,
+                                                  ResponseCache::Body const& body,
+                                                  char const* contentType) {
+  res.set_header("Vary", "Accept-Encoding");
+  auto encoding = acceptedEncoding(req.get_header_value("Accept-Encoding"));
+  if(encoding == ContentEncoding::Identity || body->size() < minimumCompressedSize) {
+    res.set_content(body->data(), body->size(), contentType);
+    return;
+  }
+
+  auto name = contentEncodingName(encoding);
+  auto compressed = cache.get(key + ' ' + name, version,
+                              [&](std::string& out) { out = compress(*body, encoding); });
+  res.set_header("Content-Encoding", name);
+  res.set_content(compressed->data(), compressed->size(), contentType);
+}
+
+template <typename RoastyImplementation>
+void RoastyServer<RoastyImplementation>::sendCached(const Request& req, Response& res,
+                                                    std::string const& key, unsigned long version,
+                                                    WireFormat format,
+                                                    ResponseCache::Renderer const& render) {
+  sendCached(req, res, key, version, format, RoastFields{}, render);
+}
+
+template <typename RoastyImplementation>
+void RoastyServer<RoastyImplementation>::sendCached(const Request& req, Response& res,
+                                                    std::string const& key, unsigned long version,
+                                                    WireFormat format, RoastFields const& fields,
+                                                    ResponseCache::Renderer const& render) {
+  if(notModified(req, res, etagOf(version, format, fields))) {
+    return;
+  }
+  sendBody(req, res, key, version, cache.get(key, version, render), mediaTypeOf(format));
+}
+
+// Static files are read once and then served from the cache
+template <typename RoastyImplementation>
+void RoastyServer<RoastyImplementation>::sendFile(const Request& req, Response& res,
+                                                  std::string const& file) {
+  auto body = cache.get(file, 0, [&](std::string& out) {
+    std::ifstream input(file);
+    out = {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+  });
+  sendBody(req, res, file, 0, body, "text/html");
+}
+
 template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>::startServer() {
 
   // =============== Bean ==================
 
   // Get all beans
-  srv.Get("/beans", [this](const Request& /*req*/, Response& res) {
+  srv.Get("/beans", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
-      auto allBeans = requestHandler->allBeans();
-
-      json beans;
-      for(auto& bean : allBeans) {
-        beans.push_back(bean.getName());
+      auto version = requestHandler->beansVersion();
+      if(notModified(req, res, etagOf(version, WireFormat::Json))) {
+        return;
       }
+      auto body = cache.get(cacheKey("/beans", WireFormat::Json), version, [&](std::string& out) {
+        auto allBeans = requestHandler->allBeans();
 
-      json j;
-      j["beans"] = beans;
+        json beans;
+        for(auto& bean : allBeans) {
+          beans.push_back(bean.getName());
+        }
 
-      res.set_content(j.dump(), "application/json");
+        json j;
+        j["beans"] = beans;
+
+        out = j.dump();
+      });
+
+      sendBody(req, res, cacheKey("/beans", WireFormat::Json), version, body,
+               mediaTypeOf(WireFormat::Json));
     });
   });
 
@@ -71,28 +429,55 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
       auto b = Bean{req.matches[1]};
       auto newName = j["beans"].get<std::string>();
 
-      requestHandler->renameBean(b, newName);
+      requestHandler->renameBean(b, newName, writeCondition(req));
     });
   });
 
   // ================== Roasts ===============
-  srv.Get("/roasts", [this](const Request& /*req*/, Response& res) {
+  srv.Get("/roasts", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
-      auto allRoasts = requestHandler->allRoasts();
-      json j;
+      auto format = responseFormat(req, res);
+      auto fields = roastFields(req);
+      // Tagged with the version of the snapshot actually served, which lags behind the latest
+      // version while a write is in progress
+      if(isPagedQuery(req)) {
+        auto filter = roastFilter(req);
+        auto page = requestHandler->findRoasts(filter);
+        if(notModified(req, res, etagOf(page.version, format, fields))) {
+          return;
+        }
+        if(page.next) {
+          res.set_header("X-Next-Cursor", cursorOf(*page.next));
+        }
+        auto key = cacheKey(filter, format, fields);
+        auto body = cache.get(key, page.version, [&](std::string& out) {
+          writeRoasts(out, page.roasts, format, fields);
+        });
+        sendBody(req, res, key, page.version, body, mediaTypeOf(format));
+        return;
+      }
 
-      for(auto& roast : allRoasts) {
-        j.push_back(roastToJson(roast));
+      auto snapshot = requestHandler->roastsSnapshot();
+      if(notModified(req, res, etagOf(snapshot.version, format, fields))) {
+        return;
+      }
+      if(snapshot.roasts->size() > streamedListingSize) {
+        streamRoasts(req, res, snapshot.roasts, format, fields);
+        return;
       }
 
-      res.set_content(j.dump(), "application/json");
+      auto key = cacheKey("/roasts", format, fields);
+      auto body = cache.get(key, snapshot.version, [&](std::string& out) {
+        writeRoasts(out, *snapshot.roasts, format, fields);
+      });
+
+      sendBody(req, res, key, snapshot.version, body, mediaTypeOf(format));
     });
   });
 
   srv.Post("/roasts", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
-      auto j = json::parse(req.body);
-      auto roast = jsonToRoast(j);
+      auto roast = parseRoast(req.body, requestFormat(req));
 
       std::stringstream newPath{};
       newPath << "/roasts/" << roast.getId();
@@ -106,10 +491,9 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
   srv.Put(R"(/roasts/(\d+))", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
       auto id = std::stol(req.matches[1]);
-      auto j = json::parse(req.body);
-      auto roast = jsonToRoast(j);
+      auto roast = parseRoast(req.body, requestFormat(req));
 
-      requestHandler->replaceRoast(id, roast);
+      requestHandler->replaceRoast(id, roast, writeCondition(req));
     });
   });
 
@@ -125,16 +509,16 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
     handleRequestWithErrorHandling(res, [&] {
       auto id = std::stol(req.matches[1]);
 
-      auto roast = roastToJson(requestHandler->getRoast(id));
       if(req.get_header_value("Accept").find("text/html") != std::string::npos) {
-        static std::string indexFile;
-        if(indexFile.empty()) {
-          std::ifstream input("../www/addRoast.html");
-          indexFile = {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
-        }
-        res.set_content(indexFile, "text/html");
+        requestHandler->getRoast(id);
+        sendFile(req, res, "../www/addRoast.html");
       } else {
-        res.set_content(roast.dump(), "application/json");
+        auto format = responseFormat(req, res);
+        auto fields = roastFields(req);
+        auto key = cacheKey("/roasts/" + std::to_string(id), format, fields);
+        auto current = requestHandler->getVersionedRoast(id);
+        sendCached(req, res, key, current.version, format, fields,
+                   [&](std::string& out) { writeRoast(out, current.roast, format, fields); });
       }
     });
   });
@@ -146,8 +530,11 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
       auto eventId = std::stol(req.matches[2]);
 
       auto event = requestHandler->getEventById(roastId, eventId);
-      auto json = eventToJson(event);
-      res.set_content(json.dump(), "application/json");
+      auto format = responseFormat(req, res);
+
+      std::string body;
+      writeEvent(body, event, format);
+      res.set_content(std::move(body), mediaTypeOf(format));
     });
   });
 
@@ -155,18 +542,88 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
     handleRequestWithErrorHandling(res, [&] {
       auto roastId = std::stol(req.matches[1]);
       auto eventId = std::stol(req.matches[2]);
-      auto j = json::parse(req.body);
+      auto event = parseEvent(req.body, requestFormat(req));
 
-      requestHandler->replaceEventInRoast(roastId, eventId, *jsonToEvent(j));
+      requestHandler->replaceEventInRoast(roastId, eventId, event, writeCondition(req));
     });
   });
 
   srv.Post(R"(/roasts/(\d+)/events)", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
       auto id = std::stol(req.matches[1]);
-      auto j = json::parse(req.body);
+      auto event = parseEvent(req.body, requestFormat(req));
 
-      requestHandler->addEventToRoast(id, *jsonToEvent(j));
+      requestHandler->addEventToRoast(id, event);
+    });
+  });
+
+  // Event values aggregated over fixed windows, so charts need not download every event
+  srv.Get(R"(/roasts/(\d+)/events)", [this](const Request& req, Response& res) {
+    handleRequestWithErrorHandling(res, [&] {
+      auto id = std::stol(req.matches[1]);
+      auto width = bucketWidth(req);
+      auto aggregates = eventAggregates(req);
+      std::optional<std::string> type;
+      if(req.has_param("type")) {
+        type = req.get_param_value("type");
+      }
+
+      auto format = responseFormat(req, res);
+      auto key = cacheKey("/roasts/" + std::to_string(id) + "/events?bucket=" +
+                              std::to_string(width) + "&agg=" + std::to_string(aggregates) +
+                              (type ? "&type=" + *type : ""),
+                          format);
+      sendCached(req, res, key, requestHandler->roastVersion(id), format, [&](std::string& out) {
+        writeEventBuckets(out, requestHandler->aggregateEvents(id, width, type), aggregates,
+                          format);
+      });
+    });
+  });
+
+  srv.Get(R"(/roasts/(\d+)/metrics)", [this](const Request& req, Response& res) {
+    handleRequestWithErrorHandling(res, [&] {
+      auto id = std::stol(req.matches[1]);
+      auto window = smoothingWindow(req);
+      auto type = req.has_param("type") ? req.get_param_value("type") : eventTypes::reading;
+
+      auto format = responseFormat(req, res);
+      auto key = cacheKey("/roasts/" + std::to_string(id) + "/metrics?window=" +
+                              std::to_string(window) + "&type=" + type,
+                          format);
+      sendCached(req, res, key, requestHandler->roastVersion(id), format, [&](std::string& out) {
+        writeRoastMetrics(out, requestHandler->roastMetrics(id, window, type), format);
+      });
+    });
+  });
+
+  // Past roasts whose temperature curves started like this one's, closest first
+  srv.Get(R"(/roasts/(\d+)/similar)", [this](const Request& req, Response& res) {
+    handleRequestWithErrorHandling(res, [&] {
+      auto id = std::stol(req.matches[1]);
+      auto k = req.has_param("k") ? numberParameter(req, "k") : 10;
+      if(k < 1 || static_cast<size_t>(k) > maximumSimilarRoasts) {
+        throw RoastyServerException{"Invalid k", Roasty<void>::errorCode};
+      }
+
+      // Any roast written can change the answer
+      auto format = responseFormat(req, res);
+      auto key = cacheKey("/roasts/" + std::to_string(id) + "/similar?k=" + std::to_string(k),
+                          format);
+      sendCached(req, res, key, requestHandler->roastsVersion(), format, [&](std::string& out) {
+        writeSimilarRoasts(out, requestHandler->similarRoasts(id, k), format);
+      });
+    });
+  });
+
+  // Telemetry is posted in batches, as a list or as newline delimited json
+  srv.Post(R"(/roasts/(\d+)/events/batch)", [this](const Request& req, Response& res) {
+    handleRequestWithErrorHandling(res, [&] {
+      auto id = std::stol(req.matches[1]);
+      auto events = req.get_header_value("Content-Type").find("ndjson") != std::string::npos
+                        ? parseEventLines(req.body)
+                        : parseEvents(req.body, requestFormat(req));
+
+      requestHandler->addEventsToRoast(id, events);
     });
   });
 
@@ -186,8 +643,11 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
       auto beanName = req.matches[2];
 
       auto blend = requestHandler->getIngredientByBeanName(roastId, beanName);
-      auto json = ingredientToJson(blend);
-      res.set_content(json.dump(), "application/json");
+      auto format = responseFormat(req, res);
+
+      std::string body;
+      writeIngredient(body, blend, format);
+      res.set_content(std::move(body), mediaTypeOf(format));
     });
   });
 
@@ -203,16 +663,16 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
 
       auto newAmount = j["newAmount"].get<int>();
 
-      requestHandler->updateIngredient(roastId, beanName, newAmount);
+      requestHandler->updateIngredient(roastId, beanName, newAmount, writeCondition(req));
     });
   });
 
   srv.Post(R"(/roasts/(\d+)/blends)", [this](const Request& req, Response& res) {
     handleRequestWithErrorHandling(res, [&] {
       auto id = std::stol(req.matches[1]);
-      auto j = json::parse(req.body);
+      auto ingredient = parseIngredient(req.body, requestFormat(req));
 
-      requestHandler->addIngredientToRoast(id, *jsonToIngredient(j));
+      requestHandler->addIngredientToRoast(id, ingredient);
     });
   });
 
@@ -225,13 +685,37 @@ template <typename RoastyImplementation> void RoastyServer<RoastyImplementation>
     });
   });
 
+  // ====================== Stats ======================
+  // Bean usage, from aggregates kept up to date by every roast write
+  srv.Get("/stats", [this](const Request& req, Response& res) {
+    handleRequestWithErrorHandling(res, [&] {
+      std::optional<std::string> bean;
+      std::optional<long> from;
+      std::optional<long> to;
+      if(req.has_param("bean")) {
+        bean = req.get_param_value("bean");
+      }
+      if(req.has_param("from")) {
+        from = numberParameter(req, "from");
+      }
+      if(req.has_param("to")) {
+        to = numberParameter(req, "to");
+      }
+
+      // Usage changes with roast writes and bean renames, both move the roasts version on
+      auto format = responseFormat(req, res);
+      auto key = cacheKey("/stats?from=" + (from ? std::to_string(*from) : "") +
+                              "&to=" + (to ? std::to_string(*to) : "") +
+                              (bean ? "&bean=" + *bean : ""),
+                          format);
+      sendCached(req, res, key, requestHandler->roastsVersion(), format, [&](std::string& out) {
+        writeBeanUsage(out, requestHandler->beanUsage(bean, from, to), format);
+      });
+    });
+  });
+
   srv.Get(R"(/)", [this](auto const& request, Response& response) {
-    static std::string indexFile;
-    if(indexFile.empty()) {
-      std::ifstream input("../www/index.html");
-      indexFile = {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
-    }
-    response.set_content(indexFile, "text/html");
+    sendFile(request, response, "../www/index.html");
   });
 
   srv.listen("localhost", getPort());
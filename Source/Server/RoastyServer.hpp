@@ -1,9 +1,13 @@
 #pragma once
 
+#include "ResponseCache.hpp"
 #include "httplib.h"
 #include <string>
 #include <utility>
 
+enum class WireFormat;
+class RoastFields;
+
 template <typename RoastyImplementation> class RoastyServer {
 public:
   RoastyServer(std::string const& interface, int const port, RoastyImplementation* requestHandler)
@@ -17,5 +21,20 @@ private:
   int const port;
   std::string const interface;
   httplib::Server srv;
+  ResponseCache cache;
+
+  // Sends a cached body, compressed if the client accepts it and the body is large enough. The
+  // compressed body is cached next to the plain one under the same version.
+  void sendBody(const httplib::Request& req, httplib::Response& res, std::string const& key,
+                unsigned long version, ResponseCache::Body const& body, char const* contentType);
+  // Answers 304 if the client already holds version, otherwise sends the body cached under key,
+  // rendering it first if version is not cached yet
+  void sendCached(const httplib::Request& req, httplib::Response& res, std::string const& key,
+                  unsigned long version, WireFormat format, ResponseCache::Renderer const& render);
+  // For roast responses limited to some of their fields, which the ETag then names as well
+  void sendCached(const httplib::Request& req, httplib::Response& res, std::string const& key,
+                  unsigned long version, WireFormat format, RoastFields const& fields,
+                  ResponseCache::Renderer const& render);
+  void sendFile(const httplib::Request& req, httplib::Response& res, std::string const& file);
   RoastyImplementation* requestHandler;
 };
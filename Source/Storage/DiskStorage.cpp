@@ -1,120 +1,723 @@
 #include "DiskStorage.hpp"
 #include "../Serialisation.hpp"
 #include "../Server/RoastyServerException.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cerrno>
 #include <exception>
+#include <fcntl.h>
+#include <filesystem>
 #include <iostream>
 #include <string>
+#include <unistd.h>
 static auto const IOdebug = false;
+
+DiskStorage::DiskStorage(std::string const& directory)
+    : beansJsonFileName(directory + "/beans.json"),
+      roastsJsonFileName(directory + "/roasts.json"),
+      snapshotFileName(directory + "/roasty.snapshot"), indexFileName(directory + "/roasty.idx"),
+      logFileName(directory + "/roasty.wal") {
+  std::ifstream log(logFileName);
+  std::string line;
+  std::streamoff completeLength = 0;
+  while(std::getline(log, line)) {
+    if(log.eof()) {
+      break;
+    }
+    completeLength += static_cast<std::streamoff>(line.size()) + 1;
+    logRecordCount++;
+  }
+  log.close();
+
+  // Drop a torn final record so that new records are not appended onto it
+  std::error_code error;
+  auto size = std::filesystem::file_size(logFileName, error);
+  if(!error && static_cast<std::streamoff>(size) > completeLength) {
+    std::filesystem::resize_file(logFileName, completeLength);
+  }
+}
+
+void DiskStorage::openSnapshot() {
+  if(snapshot) {
+    return;
+  }
+
+  // Databases written before the binary snapshot existed are converted once
+  auto migrate = !std::filesystem::exists(snapshotFileName) &&
+                 (std::filesystem::exists(roastsJsonFileName) ||
+                  std::filesystem::exists(beansJsonFileName));
+  if(migrate) {
+    convertJsonToSnapshot(beansJsonFileName, roastsJsonFileName, snapshotFileName);
+  }
+
+  if(!std::filesystem::exists(snapshotFileName)) {
+    return;
+  }
+  snapshot = std::make_unique<SnapshotFile>(snapshotFileName);
+  generation = snapshot->getGeneration();
+
+  // A missing, corrupt or stale index is rebuilt from the snapshot's offset table
+  auto valid = false;
+  if(std::filesystem::exists(indexFileName)) {
+    try {
+      index = std::make_unique<SnapshotIndex>(indexFileName);
+      valid = index->matches(*snapshot);
+    } catch(RoastyServerException& e) {
+      valid = false;
+    }
+  }
+  if(!valid) {
+    writeSnapshotIndex(indexFileName, *snapshot);
+    index = std::make_unique<SnapshotIndex>(indexFileName);
+  }
+}
+
+void DiskStorage::ensureLoaded() {
+  if(loaded.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{loadMutex};
+  if(loaded.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  openSnapshot();
+  if(snapshot) {
+    beans = snapshot->readBeans();
+    for(auto& bean : beans) {
+      bean = catalog.intern(bean);
+    }
+    beanIndex.rebuild(beans);
+    roasts = snapshot->readRoasts();
+    for(auto& roast : roasts) {
+      roast.internBeans(catalog);
+    }
+    roastIndex.rebuild(roasts);
+  } else {
+    beans.clear();
+    roasts.clear();
+  }
+
+  replayLog();
+  loaded.store(true, std::memory_order_release);
+}
+
 // ============== Bean =======================
 
+bool DiskStorage::findBean(Bean const& b, size_t& position) {
+  ensureLoaded();
+  position = beanIndex.find(beans, b.getName());
+  return position != beans.size();
+}
+
 void DiskStorage::addBean(Bean const& b) {
-  auto allBeans = getBeans();
-  allBeans.push_back(b);
-  setBean(allBeans);
+  ensureLoaded();
+  appendToLog({{"op", "addBean"}, {"name", b.getName()}});
+  applyAddBean(b.getName());
+  checkpointIfDue();
 }
 
 void DiskStorage::replaceBean(size_t position, Bean const& b) {
-  auto allBeans = getBeans();
-  allBeans[position] = b;
-  setBean(allBeans);
+  ensureLoaded();
+  auto oldBean = beans[position];
+  appendToLog({{"op", "replaceBean"}, {"name", oldBean.getName()}, {"newName", b.getName()}});
+  beans[position] = catalog.intern(b);
+  beanIndex.replaced(beans, position, oldBean.getName());
+  checkpointIfDue();
+}
+
+void DiskStorage::renameBean(size_t position, std::string const& newName) {
+  ensureLoaded();
+  auto oldName = beans[position].getName();
+  appendToLog({{"op", "renameBean"}, {"name", oldName}, {"newName", newName}});
+  applyRenameBean(oldName, newName);
+  checkpointIfDue();
 }
 
 void DiskStorage::removeBean(size_t position) {
-  auto allBeans = getBeans();
-  allBeans.erase(allBeans.begin() + position);
-  setBean(allBeans);
+  ensureLoaded();
+  auto oldBean = beans[position];
+  appendToLog({{"op", "removeBean"}, {"name", oldBean.getName()}});
+  beans.erase(beans.begin() + position);
+  beanIndex.erased(beans, position, oldBean.getName());
+  checkpointIfDue();
 }
 
-// Private method to flush to disk
-void DiskStorage::setBean(std::vector<Bean> const& bean) {
-  std::vector<std::string> beanNames{};
+std::vector<Bean> const& DiskStorage::getBeans() {
+  ensureLoaded();
+  return beans;
+}
+
+// ==================== Roasts =============================
+std::vector<Roast> const& DiskStorage::getRoasts() {
+  ensureLoaded();
+  return roasts;
+}
+
+Roast const* DiskStorage::findRoast(long id) { return locateRoast(id); }
 
-  beanNames.reserve(bean.size());
-  for(const auto& bean : bean) {
-    beanNames.push_back(bean.getName());
+// The roast is decoded on its own while that is possible, otherwise taken from the loaded database
+Roast* DiskStorage::locateRoast(long id) {
+  if(!loaded.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock{loadMutex};
+    if(servesSingleRoasts()) {
+      return decodedRoast(id);
+    }
   }
 
-  json j;
-  j["beans"] = beanNames;
-  if(IOdebug)
-    std::cout << j.dump(2) << std::endl;
-  writeJson(beansJsonFileName, j);
+  ensureLoaded();
+  return findLoadedRoast(id);
 }
 
-std::vector<Bean> const& DiskStorage::getBeans() {
-  beans = {};
-  auto data = readJson("../beans.json");
-  auto& beanStrings = data["beans"];
+// Called with loadMutex held
+bool DiskStorage::servesSingleRoasts() {
+  readLogByRoast();
+  if(loaded.load(std::memory_order_relaxed) || !logReplayableByRoast) {
+    return false;
+  }
+  auto limit = std::max<size_t>(64, snapshot ? snapshot->getRoastCount() / 4 : 0);
+  return decodedRoasts.size() < limit;
+}
 
-  try {
-    for(auto& bean : beanStrings) {
-      auto value = bean.get<std::string>();
-      beans.emplace_back(Bean{value});
+// True if a write is applied to the decoded roast it names, false once the database is loaded
+bool DiskStorage::writesByRoast() {
+  if(!loaded.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock{loadMutex};
+    if(servesSingleRoasts()) {
+      return true;
     }
-  } catch(std::exception& e) {
-    std::stringstream message{};
-    message << "Corrupt database file bean.json! Error while reading: " << e.what();
-    throw RoastyServerException{message.str(), 500};
   }
-  return beans;
+  ensureLoaded();
+  return false;
 }
 
-// ==================== Roasts =============================
-std::vector<Roast>& DiskStorage::getRoasts() {
-  roasts.clear();
-  auto json = readJson("../roasts.json");
+Roast* DiskStorage::decodedRoast(long id) {
+  auto decoded = decodedRoasts.find(id);
+  if(decoded != decodedRoasts.end()) {
+    return &decoded->second;
+  }
+
+  auto roast = decodeRoast(id);
+  if(!roast) {
+    return nullptr;
+  }
+  return &decodedRoasts.emplace(id, std::move(*roast)).first->second;
+}
+
+// Only renames and replacements giving a roast another id reach beyond the roast they name, a
+// log holding either is only ever replayed as a whole
+void DiskStorage::readLogByRoast() {
+  if(logRead) {
+    return;
+  }
+  logRead = true;
 
-  try {
-    for(auto& roastJ : json) {
-      roasts.push_back(jsonToRoast(roastJ));
+  openSnapshot();
+  std::ifstream log(logFileName);
+  std::string line;
+  while(std::getline(log, line)) {
+    // A record that does not read as expected is left to the full replay to report
+    try {
+      auto record = json::parse(line);
+      if(isFolded(record)) {
+        continue;
+      }
+
+      auto op = record["op"].get<std::string>();
+      if(op == "renameBean" ||
+         (op == "replaceRoast" && record["id"] != record["roast"]["id"])) {
+        logReplayableByRoast = false;
+        return;
+      }
+      if(op == "addRoast") {
+        auto id = record["roast"]["id"].get<long>();
+        keepRoastRecord(id, std::move(record));
+      } else if(record.contains("id")) {
+        auto id = record["id"].get<long>();
+        keepRoastRecord(id, std::move(record));
+      } else {
+        logHoldsBeanRecords = true;
+      }
+    } catch(json::exception& e) {
+      logReplayableByRoast = false;
+      return;
     }
+  }
+}
 
-  } catch(std::exception& e) {
-    std::stringstream message{};
-    message << "Corrupt database file roasts.json! Error while reading: " << e.what();
-    throw RoastyServerException{message.str(), 500};
+// The roast as it is in the snapshot, brought up to date by the logged records naming it
+std::optional<Roast> DiskStorage::decodeRoast(long id) {
+  openSnapshot();
+  std::optional<Roast> roast;
+  auto const* entry = snapshot ? index->find(id) : nullptr;
+  if(entry != nullptr) {
+    roast = snapshot->getRoast(*entry);
   }
 
-  return roasts;
+  auto logged = loggedRoastRecords.find(id);
+  if(logged == loggedRoastRecords.end()) {
+    return roast;
+  }
+  for(auto& record : logged->second) {
+    auto op = record["op"].get<std::string>();
+    if(op == "addRoast" || op == "replaceRoast") {
+      roast = jsonToRoast(record["roast"]);
+    } else if(op == "removeRoast") {
+      roast.reset();
+    } else if(roast) {
+      applyToRoast(*roast, op, record);
+    }
+  }
+  if(roast) {
+    roast->internBeans(catalog);
+  }
+  return roast;
+}
+
+void DiskStorage::keepRoastRecord(long id, json record) {
+  auto& records = loggedRoastRecords[id];
+  if(records.empty()) {
+    loggedRoastIds.push_back(id);
+  }
+  records.push_back(std::move(record));
+}
+
+// Until the database is loaded the record is kept for decoding the roast again as well
+void DiskStorage::logRoastRecord(long id, json record) {
+  appendToLog(record);
+  if(!loaded.load(std::memory_order_relaxed)) {
+    keepRoastRecord(id, std::move(record));
+  }
+}
+
+void DiskStorage::setRoasts(std::vector<Roast> const& newRoasts) {
+  ensureLoaded();
+  decodedRoasts.clear();
+  if(&newRoasts != &roasts) {
+    roasts = newRoasts;
+    for(auto& roast : roasts) {
+      roast.internBeans(catalog);
+    }
+    roastIndex.rebuild(roasts);
+  }
+
+  // A full rewrite supersedes every logged record, so the beans are folded in as well. The log
+  // is only truncated once the new snapshot is on disk; if the truncation itself is lost the
+  // records still carry the generation of the snapshot before and are skipped on replay.
+  index.reset();
+  snapshot.reset();
+  writeSnapshot(snapshotFileName, beans, roasts, generation);
+  SnapshotFile written{snapshotFileName};
+  writeSnapshotIndex(indexFileName, written);
+  generation = written.getGeneration();
+  std::ofstream truncate(logFileName, std::ios::trunc);
+  logRecordCount = 0;
+}
+
+void DiskStorage::addRoast(Roast const& roast) {
+  auto byRoast = writesByRoast();
+  logRoastRecord(roast.getId(), {{"op", "addRoast"}, {"roast", roastToJson(roast)}});
+  if(byRoast) {
+    decodedRoasts.insert_or_assign(roast.getId(), roast).first->second.internBeans(catalog);
+  } else {
+    applyAddRoast(roast);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::removeRoast(long id) {
+  auto byRoast = writesByRoast();
+  logRoastRecord(id, {{"op", "removeRoast"}, {"id", id}});
+  if(byRoast) {
+    decodedRoasts.erase(id);
+  } else {
+    applyRemoveRoast(id);
+  }
+  checkpointIfDue();
+}
+
+// Giving the roast another id reaches beyond the roast named, so that loads the database
+void DiskStorage::replaceRoast(long id, Roast const& roast) {
+  if(id != roast.getId() && !loaded.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock{loadMutex};
+    logReplayableByRoast = false;
+  }
+  auto byRoast = writesByRoast();
+  logRoastRecord(id, {{"op", "replaceRoast"}, {"id", id}, {"roast", roastToJson(roast)}});
+  if(byRoast) {
+    decodedRoasts.insert_or_assign(id, roast).first->second.internBeans(catalog);
+  } else {
+    applyReplaceRoast(id, roast);
+  }
+  checkpointIfDue();
+}
+
+// ==================== Events and ingredients =============================
+void DiskStorage::addEvent(long roastId, Event const& event) {
+  auto* roast = locateRoast(roastId);
+  logRoastRecord(roastId, {{"op", "addEvent"}, {"id", roastId}, {"event", eventToJson(event)}});
+  if(roast != nullptr) {
+    applyAddEvent(*roast, event);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::addEvents(long roastId, std::vector<Event> const& events) {
+  auto* roast = locateRoast(roastId);
+  json logged = json::array();
+  for(auto& event : events) {
+    logged.push_back(eventToJson(event));
+  }
+  logRoastRecord(roastId, {{"op", "addEvents"}, {"id", roastId}, {"events", std::move(logged)}});
+  if(roast != nullptr) {
+    applyAddEvents(*roast, events);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::removeEvent(long roastId, long timestamp) {
+  auto* roast = locateRoast(roastId);
+  logRoastRecord(roastId, {{"op", "removeEvent"}, {"id", roastId}, {"timestamp", timestamp}});
+  if(roast != nullptr) {
+    applyRemoveEvent(*roast, timestamp);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::replaceEvent(long roastId, long oldTimestamp, Event const& event) {
+  auto* roast = locateRoast(roastId);
+  logRoastRecord(roastId, {{"op", "replaceEvent"},
+                           {"id", roastId},
+                           {"timestamp", oldTimestamp},
+                           {"event", eventToJson(event)}});
+  if(roast != nullptr) {
+    applyReplaceEvent(*roast, oldTimestamp, event);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::addIngredient(long roastId, Ingredient const& ingredient) {
+  auto* roast = locateRoast(roastId);
+  logRoastRecord(roastId, {{"op", "setIngredient"},
+                           {"id", roastId},
+                           {"ingredient", ingredientToJson(ingredient)}});
+  if(roast != nullptr) {
+    applySetIngredient(*roast, ingredient);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::updateIngredient(long roastId, std::string const& beanName, int amount) {
+  addIngredient(roastId, Ingredient{Bean{beanName}, amount});
+}
+
+void DiskStorage::removeIngredient(long roastId, std::string const& beanName) {
+  auto* roast = locateRoast(roastId);
+  logRoastRecord(roastId, {{"op", "removeIngredient"}, {"id", roastId}, {"name", beanName}});
+  if(roast != nullptr) {
+    applyRemoveIngredient(*roast, beanName);
+  }
+  checkpointIfDue();
+}
+
+void DiskStorage::checkpoint() {
+  if(writesByRoast() && !logHoldsBeanRecords) {
+    checkpointByRoast();
+  } else {
+    setRoasts(getRoasts());
+  }
 }
 
-void DiskStorage::setRoasts(std::vector<Roast> const& roasts) {
-  json j;
+// The roasts no record names are copied from the old snapshot, the others are taken as decoded,
+// followed by the roasts new to the snapshot in the order they were logged
+void DiskStorage::checkpointByRoast() {
+  struct Source {
+    snapshot::SnapshotRoastEntry const* entry;
+    Roast const* decoded;
+  };
+  std::vector<Source> sources;
+  std::vector<Bean> snapshotBeans;
+  if(snapshot) {
+    snapshotBeans = snapshot->readBeans();
+    sources.reserve(snapshot->getRoastCount());
+    for(size_t i = 0; i < snapshot->getRoastCount(); i++) {
+      auto const& entry = snapshot->getRoastEntry(i);
+      if(loggedRoastRecords.count(entry.id) == 0) {
+        sources.push_back({&entry, nullptr});
+      } else if(auto const* roast = decodedRoast(entry.id)) {
+        sources.push_back({nullptr, roast});
+      }
+    }
+  }
+  for(auto id : loggedRoastIds) {
+    auto inSnapshot = snapshot && index->find(id) != nullptr;
+    if(!inSnapshot) {
+      if(auto const* roast = decodedRoast(id)) {
+        sources.push_back({nullptr, roast});
+      }
+    }
+  }
 
-  for(const auto& roast : roasts) {
-    j.push_back(roastToJson(roast));
+  std::optional<Roast> copied;
+  writeSnapshot(
+      snapshotFileName, snapshotBeans, sources.size(),
+      [&](size_t i) -> Roast const& {
+        auto const& source = sources[i];
+        if(source.decoded != nullptr) {
+          return *source.decoded;
+        }
+        return copied.emplace(snapshot->getRoast(*source.entry));
+      },
+      generation);
+
+  // The old snapshot stays mapped until here, the new one was written beside it and renamed
+  index.reset();
+  snapshot.reset();
+  SnapshotFile written{snapshotFileName};
+  writeSnapshotIndex(indexFileName, written);
+  generation = written.getGeneration();
+  std::ofstream truncate(logFileName, std::ios::trunc);
+  logRecordCount = 0;
+  decodedRoasts.clear();
+  loggedRoastRecords.clear();
+  loggedRoastIds.clear();
+}
+
+void DiskStorage::checkpointIfDue() {
+  if(logRecordCount >= checkpointInterval) {
+    checkpoint();
   }
+}
+
+// ==================== Write-ahead log =============================
+// The record is on stable storage before the write is acknowledged. A failed append can leave a
+// torn record at the end, which the next startup drops.
+void DiskStorage::appendToLog(json record) {
+  record["generation"] = generation;
+  auto line = record.dump() + '\n';
+  auto created = logRecordCount == 0 && !std::filesystem::exists(logFileName);
+
+  auto descriptor = ::open(logFileName.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if(descriptor < 0) {
+    throw RoastyServerException{"Error writing database log", 500};
+  }
+  auto const* next = line.data();
+  auto remaining = line.size();
+  while(remaining > 0) {
+    auto written = ::write(descriptor, next, remaining);
+    if(written < 0 && errno == EINTR) {
+      continue;
+    }
+    if(written <= 0) {
+      ::close(descriptor);
+      throw RoastyServerException{"Error writing database log", 500};
+    }
+    next += written;
+    remaining -= written;
+  }
+  auto synced = ::fdatasync(descriptor) == 0;
+  ::close(descriptor);
+  if(!synced) {
+    throw RoastyServerException{"Error writing database log", 500};
+  }
+  if(created) {
+    syncDirectoryOf(logFileName);
+  }
+
   if(IOdebug)
-    std::cout << j.dump(2) << std::endl;
-  writeJson(roastsJsonFileName, j);
+    std::cout << record.dump(2) << std::endl;
+
+  logRecordCount++;
 }
 
-json DiskStorage::readJson(std::string const& file) {
-  std::ifstream i(file);
+void DiskStorage::replayLog() {
+  std::ifstream i(logFileName);
+  std::string line;
+  std::string next;
 
-  if(i.fail()) {
-    return {};
+  if(!std::getline(i, line)) {
+    return;
   }
 
-  try {
-    json j;
-    i >> j;
-    return j;
-  } catch(std::exception& e) {
-    throw RoastyServerException("Corrupt database file", 500);
+  // Records are replayed in order; a torn final record from an interrupted append is skipped
+  while(true) {
+    auto isLast = !std::getline(i, next);
+    try {
+      auto record = json::parse(line);
+      if(!isFolded(record)) {
+        applyRecord(record);
+      }
+    } catch(json::exception& e) {
+      if(!isLast) {
+        std::stringstream message{};
+        message << "Corrupt database log! Error while replaying: " << e.what();
+        throw RoastyServerException{message.str(), 500};
+      }
+    }
+    if(isLast) {
+      return;
+    }
+    line = std::move(next);
   }
 }
 
-void DiskStorage::writeJson(std::string const& file, json& j) {
-  std::ofstream o(file);
+// Records logged on top of another snapshot than the current one were folded into it by a
+// checkpoint whose truncation of the log was lost. Logs written before records were tagged are
+// replayed whole.
+bool DiskStorage::isFolded(json const& record) const {
+  return record.contains("generation") &&
+         record["generation"].get<std::uint32_t>() != generation;
+}
+
+void DiskStorage::applyRecord(json& record) {
+  auto op = record["op"].get<std::string>();
+
+  if(op == "addBean") {
+    applyAddBean(record["name"].get<std::string>());
+  } else if(op == "replaceBean") {
+    applyReplaceBean(record["name"].get<std::string>(), record["newName"].get<std::string>());
+  } else if(op == "renameBean") {
+    applyRenameBean(record["name"].get<std::string>(), record["newName"].get<std::string>());
+  } else if(op == "removeBean") {
+    applyRemoveBean(record["name"].get<std::string>());
+  } else if(op == "addRoast") {
+    applyAddRoast(jsonToRoast(record["roast"]));
+  } else if(op == "removeRoast") {
+    applyRemoveRoast(record["id"].get<long>());
+  } else if(op == "replaceRoast") {
+    applyReplaceRoast(record["id"].get<long>(), jsonToRoast(record["roast"]));
+  } else if(record.contains("id")) {
+    if(auto* roast = findLoadedRoast(record["id"].get<long>())) {
+      applyToRoast(*roast, op, record);
+    }
+  }
+}
+
+// Event and ingredient records, applied to a roast of the loaded database or to one replayed on
+// its own
+void DiskStorage::applyToRoast(Roast& roast, std::string const& op, json& record) {
+  if(op == "addEvent") {
+    std::unique_ptr<Event> event{jsonToEvent(record["event"])};
+    applyAddEvent(roast, *event);
+  } else if(op == "addEvents") {
+    std::vector<Event> events;
+    for(auto& logged : record["events"]) {
+      std::unique_ptr<Event> event{jsonToEvent(logged)};
+      events.push_back(std::move(*event));
+    }
+    applyAddEvents(roast, events);
+  } else if(op == "removeEvent") {
+    applyRemoveEvent(roast, record["timestamp"].get<long>());
+  } else if(op == "replaceEvent") {
+    std::unique_ptr<Event> event{jsonToEvent(record["event"])};
+    applyReplaceEvent(roast, record["timestamp"].get<long>(), *event);
+  } else if(op == "setIngredient") {
+    std::unique_ptr<Ingredient> ingredient{jsonToIngredient(record["ingredient"])};
+    applySetIngredient(roast, *ingredient);
+  } else if(op == "removeIngredient") {
+    applyRemoveIngredient(roast, record["name"].get<std::string>());
+  }
+}
 
-  if(o.fail()) {
-    throw RoastyServerException{"Error reading database file", 500};
+void DiskStorage::applyAddBean(std::string const& name) {
+  if(beanIndex.find(beans, name) == beans.size()) {
+    beans.push_back(catalog.intern(Bean{name}));
+    beanIndex.added(beans);
   }
+}
+
+void DiskStorage::applyReplaceBean(std::string const& name, std::string const& newName) {
+  auto position = beanIndex.find(beans, name);
+  if(position != beans.size()) {
+    beans[position] = catalog.intern(Bean{newName});
+    beanIndex.replaced(beans, position, name);
+  }
+}
+
+// Renaming the catalog's name renames the bean in every roast using it as well
+void DiskStorage::applyRenameBean(std::string const& name, std::string const& newName) {
+  auto position = beanIndex.find(beans, name);
+  if(position != beans.size()) {
+    catalog.rename(beans[position], newName);
+    beanIndex.replaced(beans, position, name);
+  }
+}
+
+void DiskStorage::applyRemoveBean(std::string const& name) {
+  auto position = beanIndex.find(beans, name);
+  if(position != beans.size()) {
+    beans.erase(beans.begin() + position);
+    beanIndex.erased(beans, position, name);
+  }
+}
 
-  if(j.empty()) {
-    j = std::vector<int>{};
+void DiskStorage::applyAddRoast(Roast const& roast) {
+  auto slot = roastIndex.find(roasts, roast.getId());
+  if(slot == roasts.size()) {
+    roasts.push_back(roast);
+    roasts.back().internBeans(catalog);
+    roastIndex.added(roasts);
+  } else {
+    roasts[slot] = roast;
+    roasts[slot].internBeans(catalog);
   }
+}
+
+void DiskStorage::applyRemoveRoast(long id) {
+  auto slot = roastIndex.find(roasts, id);
+  if(slot != roasts.size()) {
+    roasts.erase(roasts.begin() + slot);
+    roastIndex.erased(roasts, slot, id);
+  }
+}
+
+void DiskStorage::applyReplaceRoast(long id, Roast const& roast) {
+  auto slot = roastIndex.find(roasts, id);
+  if(slot == roasts.size()) {
+    applyAddRoast(roast);
+  } else {
+    roasts[slot] = roast;
+    roasts[slot].internBeans(catalog);
+    roastIndex.replaced(roasts, slot, id);
+  }
+}
+
+Roast* DiskStorage::findLoadedRoast(long id) {
+  auto slot = roastIndex.find(roasts, id);
+  return slot == roasts.size() ? nullptr : &roasts[slot];
+}
+
+// Events are keyed by timestamp and ingredients by bean, so adding one replaces any existing
+// entry with the same key and replaying the record twice leaves a single copy
+void DiskStorage::applyAddEvent(Roast& roast, Event const& event) {
+  roast.removeEventByTimestamp(event.getTimestamp());
+  roast.addEvent(event);
+}
+
+// Only events already present, i.e. a batch replayed twice, are removed one by one
+void DiskStorage::applyAddEvents(Roast& roast, std::vector<Event> const& events) {
+  for(auto& event : events) {
+    roast.removeEventByTimestamp(event.getTimestamp());
+    roast.addEvent(event);
+  }
+}
+
+void DiskStorage::applyRemoveEvent(Roast& roast, long timestamp) {
+  roast.removeEventByTimestamp(timestamp);
+}
+
+void DiskStorage::applyReplaceEvent(Roast& roast, long oldTimestamp, Event const& event) {
+  roast.removeEventByTimestamp(oldTimestamp);
+  roast.removeEventByTimestamp(event.getTimestamp());
+  roast.addEvent(event);
+}
+
+void DiskStorage::applySetIngredient(Roast& roast, Ingredient const& ingredient) {
+  roast.removeIngredientByBeanName(ingredient.getBean().getName());
+  roast.addIngredient(Ingredient{catalog.intern(ingredient.getBean()), ingredient.getAmount()});
+}
 
-  o << j;
+void DiskStorage::applyRemoveIngredient(Roast& roast, std::string const& beanName) {
+  roast.removeIngredientByBeanName(beanName);
 }
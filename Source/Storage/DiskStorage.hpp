@@ -1,33 +1,138 @@
 #pragma once
 
 #include "../Model/RoastyModel.hpp"
+#include "SlotIndex.hpp"
+#include "Snapshot.hpp"
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using json = nlohmann::json;
 
+// Not synchronised for writers, callers serialise every mutation against all other calls. Reads
+// may run concurrently with each other; the lazy loading they trigger is guarded internally.
+//
+// Durability: a mutation returns once its log record has been synced to disk, so an acknowledged
+// write survives a crash. Checkpoints sync the new snapshot and index and the directory holding
+// them before the log is truncated. Every record carries the generation of the snapshot it was
+// logged on top of, so if the truncation is lost the records the new snapshot already holds are
+// skipped rather than applied twice. A checkpoint runs on the write that fills the log, under the
+// caller's exclusive access, so that one write costs a full snapshot of the database.
 class DiskStorage {
 public:
+  explicit DiskStorage(std::string const& directory = "..");
+
   std::vector<Bean> const& getBeans();
+  bool findBean(Bean const& b, size_t& position);
   void addBean(Bean const& b);
   void removeBean(size_t position);
   void replaceBean(size_t position, Bean const& b);
+  void renameBean(size_t position, std::string const& newName);
   Bean const& getBean(int i) { return getBeans()[i]; };
+  // Holds the names of the beans and ingredients loaded so far
+  BeanCatalog const& getCatalog() const { return catalog; }
 
-  std::vector<Roast>& getRoasts();
+  std::vector<Roast> const& getRoasts();
+  Roast const* findRoast(long id);
   void setRoasts(std::vector<Roast> const& roasts);
+  void addRoast(Roast const& roast);
+  void removeRoast(long id);
+  void replaceRoast(long id, Roast const& roast);
+
+  // Mutate a single roast in place, only the change itself is logged
+  void addEvent(long roastId, Event const& event);
+  // Adds all events with a single log record, so they are replayed all or not at all
+  void addEvents(long roastId, std::vector<Event> const& events);
+  void removeEvent(long roastId, long timestamp);
+  void replaceEvent(long roastId, long oldTimestamp, Event const& event);
+  void addIngredient(long roastId, Ingredient const& ingredient);
+  void updateIngredient(long roastId, std::string const& beanName, int amount);
+  void removeIngredient(long roastId, std::string const& beanName);
+
+  // Folds the write-ahead log into the snapshot and truncates it
+  void checkpoint();
 
 private:
-  // Internal methods used to store to disk
+  // In-memory copy of the database, loaded once and kept in step with every write
   std::vector<Bean> beans;
   std::vector<Roast> roasts;
-  std::string const beansJsonFileName = "../beans.json";
-  std::string const roastsJsonFileName = "../roasts.json";
-  void setBean(std::vector<Bean> const& beans);
+  BeanIndex beanIndex;
+  RoastIndex roastIndex;
+  BeanCatalog catalog;
+  std::atomic<bool> loaded{false};
+  std::mutex loadMutex; // Guards loading and the decoded roasts below for concurrent readers
+  void ensureLoaded();
+
+  // Until the whole database is loaded single roasts are decoded from the snapshot on demand,
+  // located through the sidecar index, and the records logged for them since are replayed onto
+  // them. Writes naming a single roast are applied to its decoded copy and kept with its records,
+  // and a checkpoint writes the new snapshot from the old one roast by roast, so neither loads the
+  // database. Listings, bean writes and the indexes over all roasts still need every roast and
+  // load it whole, as does a log holding records that reach beyond one roast. Entries are only
+  // dropped by a checkpoint, which runs under the writer's exclusive access, so pointers handed
+  // out to concurrent readers stay valid; once a quarter of the snapshot's roasts were decoded
+  // one by one the database is loaded instead, which bounds the copies to a fraction of it.
+  std::unique_ptr<SnapshotFile> snapshot;
+  std::unique_ptr<SnapshotIndex> index;
+  std::unordered_map<long, Roast> decodedRoasts;
+  std::unordered_map<long, std::vector<json>> loggedRoastRecords;
+  // In the order they were first logged, which is where roasts new to the snapshot are placed
+  std::vector<long> loggedRoastIds;
+  bool logRead = false;
+  bool logReplayableByRoast = true;
+  bool logHoldsBeanRecords = false;
+  void openSnapshot();
+  void readLogByRoast();
+  bool servesSingleRoasts();
+  bool writesByRoast();
+  Roast* locateRoast(long id);
+  Roast* decodedRoast(long id);
+  std::optional<Roast> decodeRoast(long id);
+  void keepRoastRecord(long id, json record);
+  void logRoastRecord(long id, json record);
+  void checkpointByRoast();
+
+  // Internal methods used to store to disk
+  std::string const beansJsonFileName;
+  std::string const roastsJsonFileName;
+  std::string const snapshotFileName;
+  std::string const indexFileName;
+  std::string const logFileName;
+  size_t logRecordCount = 0;
+  // Of the snapshot new records are logged on top of, zero while there is none
+  std::uint32_t generation = 0;
+  // Number of log records after which the log is folded into the snapshot
+  static size_t const checkpointInterval = 1024;
+
+  // Write-ahead log: one json record per line, replayed on top of the snapshot
+  void appendToLog(json record);
+  bool isFolded(json const& record) const;
+  void checkpointIfDue();
+  void replayLog();
+  void applyRecord(json& record);
 
-  static json readJson(std::string const& file);
-  static void writeJson(std::string const& file, json& j);
+  // Apply a single mutation to the in-memory copy
+  void applyAddBean(std::string const& name);
+  void applyReplaceBean(std::string const& name, std::string const& newName);
+  void applyRenameBean(std::string const& name, std::string const& newName);
+  void applyRemoveBean(std::string const& name);
+  void applyAddRoast(Roast const& roast);
+  void applyRemoveRoast(long id);
+  void applyReplaceRoast(long id, Roast const& roast);
+  void applyToRoast(Roast& roast, std::string const& op, json& record);
+  static void applyAddEvent(Roast& roast, Event const& event);
+  static void applyAddEvents(Roast& roast, std::vector<Event> const& events);
+  static void applyRemoveEvent(Roast& roast, long timestamp);
+  static void applyReplaceEvent(Roast& roast, long oldTimestamp, Event const& event);
+  void applySetIngredient(Roast& roast, Ingredient const& ingredient);
+  static void applyRemoveIngredient(Roast& roast, std::string const& beanName);
+  Roast* findLoadedRoast(long id);
 };
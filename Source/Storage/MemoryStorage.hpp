@@ -1,20 +1,133 @@
 #pragma once
 
+#include "SlotIndex.hpp"
+#include <algorithm>
+#include <vector>
+
 class MemoryStorage {
 public:
   // Use these methods to interact with the database
   std::vector<Bean> getBeans() const { return beans; }
   size_t getBeanCount() const { return beans.size(); }
-  void addBean(Bean const& b) { beans.push_back(b); };
-  void replaceBean(size_t position, Bean const& b) { beans[position] = b; }
-  void removeBean(size_t i) { beans.erase(beans.begin() + i); };
+  BeanCatalog const& getCatalog() const { return catalog; }
+  bool findBean(Bean const& b, size_t& position) {
+    position = beanIndex.find(beans, b.getName());
+    return position != beans.size();
+  }
+  void addBean(Bean const& b) {
+    beans.push_back(catalog.intern(b));
+    beanIndex.added(beans);
+  };
+  void replaceBean(size_t position, Bean const& b) {
+    auto oldName = beans[position].getName();
+    beans[position] = catalog.intern(b);
+    beanIndex.replaced(beans, position, oldName);
+  }
+  void renameBean(size_t position, std::string const& newName) {
+    auto oldName = beans[position].getName();
+    catalog.rename(beans[position], newName);
+    beanIndex.replaced(beans, position, oldName);
+  }
+  void removeBean(size_t i) {
+    auto name = beans[i].getName();
+    beans.erase(beans.begin() + i);
+    beanIndex.erased(beans, i, name);
+  };
   Bean& getBean(int i) { return beans[i]; };
 
-  void setBean(std::vector<Bean> beans) { this->beans = beans; }
+  void setBean(std::vector<Bean> beans) {
+    this->beans.clear();
+    for(auto& bean : beans) {
+      this->beans.push_back(catalog.intern(bean));
+    }
+    beanIndex.rebuild(this->beans);
+  }
 
   std::vector<Roast>& getRoasts() { return roasts; }
-  void setRoasts(std::vector<Roast> roasts) { this->roasts = roasts; }
+  Roast const* findRoast(long id) {
+    auto slot = roastIndex.find(roasts, id);
+    return slot == roasts.size() ? nullptr : &roasts[slot];
+  }
+  void setRoasts(std::vector<Roast> roasts) {
+    for(auto& roast : roasts) {
+      roast.internBeans(catalog);
+    }
+    this->roasts = std::move(roasts);
+    roastIndex.rebuild(this->roasts);
+  }
+  void addRoast(Roast const& roast) {
+    roasts.push_back(roast);
+    roasts.back().internBeans(catalog);
+    roastIndex.added(roasts);
+  }
+  void removeRoast(long id) {
+    auto slot = roastIndex.find(roasts, id);
+    if(slot != roasts.size()) {
+      roasts.erase(roasts.begin() + slot);
+      roastIndex.erased(roasts, slot, id);
+    }
+  }
+  void replaceRoast(long id, Roast const& roast) {
+    auto slot = roastIndex.find(roasts, id);
+    if(slot != roasts.size()) {
+      roasts[slot] = roast;
+      roasts[slot].internBeans(catalog);
+      roastIndex.replaced(roasts, slot, id);
+    }
+  }
+
+  // Mutate a single roast in place
+  void addEvent(long roastId, Event const& event) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->addEvent(event);
+    }
+  }
+  void addEvents(long roastId, std::vector<Event> const& events) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      for(auto& event : events) {
+        roast->addEvent(event);
+      }
+    }
+  }
+  void removeEvent(long roastId, long timestamp) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->removeEventByTimestamp(timestamp);
+    }
+  }
+  void replaceEvent(long roastId, long oldTimestamp, Event const& event) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->removeEventByTimestamp(oldTimestamp);
+      roast->addEvent(event);
+    }
+  }
+  void addIngredient(long roastId, Ingredient const& ingredient) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->addIngredient(
+          Ingredient{catalog.intern(ingredient.getBean()), ingredient.getAmount()});
+    }
+  }
+  void updateIngredient(long roastId, std::string const& beanName, int amount) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->removeIngredientByBeanName(beanName);
+      roast->addIngredient(Ingredient{catalog.intern(Bean{beanName}), amount});
+    }
+  }
+  void removeIngredient(long roastId, std::string const& beanName) {
+    if(auto* roast = findMutableRoast(roastId)) {
+      roast->removeIngredientByBeanName(beanName);
+    }
+  }
 
   std::vector<Bean> beans;
   std::vector<Roast> roasts;
+  BeanIndex beanIndex;
+  RoastIndex roastIndex;
+  // Beans and ingredients added through the methods above share their names through the catalog
+  BeanCatalog catalog;
+
+private:
+  Roast* findMutableRoast(long id) {
+    auto slot = roastIndex.find(roasts, id);
+    return slot == roasts.size() ? nullptr : &roasts[slot];
+  }
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../Model/RoastyModel.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Maps keys to their element's slot in one of a storage's vectors. The storage reports every
+// change it makes to the vector, a vector changed in any other way needs a rebuild. Lookups never
+// write to the index, so concurrent lookups under a shared lock are safe.
+template <typename Element, typename Key, Key (*keyOf)(Element const&)> class SlotIndex {
+public:
+  // Returns the slot of the element with the given key, or elements.size() if there is none
+  size_t find(std::vector<Element> const& elements, Key const& key) const {
+    auto it = slots.find(key);
+    return it == slots.end() ? elements.size() : it->second;
+  }
+
+  // Call after an element was appended to the vector
+  void added(std::vector<Element> const& elements) {
+    slots[keyOf(elements.back())] = elements.size() - 1;
+  }
+
+  // Call after the element in the given slot was replaced, possibly by one with another key
+  void replaced(std::vector<Element> const& elements, size_t slot, Key const& oldKey) {
+    slots.erase(oldKey);
+    slots[keyOf(elements[slot])] = slot;
+  }
+
+  // Call after the element with the given key was erased from the given slot
+  void erased(std::vector<Element> const& elements, size_t slot, Key const& key) {
+    slots.erase(key);
+    for(auto i = slot; i < elements.size(); i++) {
+      slots[keyOf(elements[i])] = i;
+    }
+  }
+
+  void rebuild(std::vector<Element> const& elements) {
+    slots.clear();
+    slots.reserve(elements.size());
+    for(auto i = 0U; i < elements.size(); i++) {
+      slots[keyOf(elements[i])] = i;
+    }
+  }
+
+private:
+  std::unordered_map<Key, size_t> slots;
+};
+
+inline long roastIdOf(Roast const& roast) { return roast.getId(); }
+inline std::string beanNameOf(Bean const& bean) { return bean.getName(); }
+
+using RoastIndex = SlotIndex<Roast, long, roastIdOf>;
+// Beans are found by name, so a bean that is renamed has to be reported as replaced
+using BeanIndex = SlotIndex<Bean, std::string, beanNameOf>;
@@ -0,0 +1,472 @@
+#include "Snapshot.hpp"
+#include "../Serialisation.hpp"
+#include "../Server/RoastyServerException.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace snapshot;
+
+static void corrupt(std::string const& reason) {
+  std::stringstream message{};
+  message << "Corrupt database snapshot! " << reason;
+  throw RoastyServerException{message.str(), 500};
+}
+
+// Records are padded to a multiple of 8 bytes so every section stays aligned
+static std::uint64_t paddedLength(std::uint64_t length) { return (length + 7) & ~std::uint64_t{7}; }
+
+// ==================== Durability =============================
+void syncFile(std::string const& file) {
+  auto descriptor = ::open(file.c_str(), O_RDONLY);
+  auto synced = descriptor >= 0 && ::fsync(descriptor) == 0;
+  if(descriptor >= 0) {
+    ::close(descriptor);
+  }
+  if(!synced) {
+    throw RoastyServerException{"Error syncing " + file, 500};
+  }
+}
+
+void syncDirectoryOf(std::string const& file) {
+  auto directory = std::filesystem::path{file}.parent_path();
+  syncFile(directory.empty() ? "." : directory.string());
+}
+
+// The temporary file is on disk before it is renamed, and the rename is on disk before this
+// returns, so after a crash the target holds either its old or its new contents in full
+static void replaceFile(std::string const& temporaryFile, std::string const& file,
+                        char const* error) {
+  syncFile(temporaryFile);
+  if(std::rename(temporaryFile.c_str(), file.c_str()) != 0) {
+    throw RoastyServerException{error, 500};
+  }
+  syncDirectoryOf(file);
+}
+
+// ==================== Mapping =============================
+MappedFile::MappedFile(std::string const& file) {
+  auto descriptor = ::open(file.c_str(), O_RDONLY);
+  if(descriptor < 0) {
+    throw RoastyServerException{"Error reading database snapshot", 500};
+  }
+
+  struct stat status {};
+  if(::fstat(descriptor, &status) != 0 || status.st_size == 0) {
+    ::close(descriptor);
+    corrupt("File is empty");
+  }
+
+  size = static_cast<size_t>(status.st_size);
+  auto* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  ::close(descriptor);
+  if(mapped == MAP_FAILED) {
+    throw RoastyServerException{"Error mapping database snapshot", 500};
+  }
+  data = static_cast<unsigned char const*>(mapped);
+}
+
+MappedFile::~MappedFile() { ::munmap(const_cast<unsigned char*>(data), size); }
+
+// ==================== Reading =============================
+SnapshotFile::SnapshotFile(std::string const& file) : mapping(file), data(mapping.getData()) {
+  if(mapping.getSize() < sizeof(SnapshotHeader)) {
+    corrupt("File is too small");
+  }
+  if(std::memcmp(header().magic, magic, sizeof(magic)) != 0) {
+    corrupt("Unknown file format");
+  }
+  if(header().version != currentVersion && header().version != eventRecordsVersion) {
+    corrupt("Unsupported version");
+  }
+
+  auto tablesLength = header().beanCount * sizeof(SnapshotString) +
+                      header().roastCount * sizeof(SnapshotRoastEntry);
+  checkRange(sizeof(SnapshotHeader), tablesLength);
+  checkRange(header().stringTableOffset, header().stringTableSize);
+}
+
+SnapshotHeader const& SnapshotFile::header() const {
+  return *reinterpret_cast<SnapshotHeader const*>(data);
+}
+
+void SnapshotFile::checkRange(std::uint64_t offset, std::uint64_t length) const {
+  if(offset > getSize() || length > getSize() - offset) {
+    corrupt("Offset out of range");
+  }
+}
+
+std::string SnapshotFile::readString(SnapshotString const& string) const {
+  if(string.offset > header().stringTableSize ||
+     string.length > header().stringTableSize - string.offset) {
+    corrupt("String out of range");
+  }
+  auto const* begin = data + header().stringTableOffset + string.offset;
+  return std::string(reinterpret_cast<char const*>(begin), string.length);
+}
+
+Bean SnapshotFile::getBean(size_t i) const {
+  auto const* names = reinterpret_cast<SnapshotString const*>(data + sizeof(SnapshotHeader));
+  return Bean{readString(names[i])};
+}
+
+SnapshotRoastEntry const& SnapshotFile::getRoastEntry(size_t i) const {
+  auto const* entries = reinterpret_cast<SnapshotRoastEntry const*>(
+      data + sizeof(SnapshotHeader) + header().beanCount * sizeof(SnapshotString));
+  return entries[i];
+}
+
+Roast SnapshotFile::getRoast(SnapshotRoastEntry const& entry) const {
+  checkRange(entry.offset, entry.length);
+  if(entry.length < sizeof(SnapshotRoast)) {
+    corrupt("Roast record is too small");
+  }
+
+  auto const& packed = *reinterpret_cast<SnapshotRoast const*>(data + entry.offset);
+  if(packed.id != entry.id) {
+    corrupt("Roast record does not match its offset table entry");
+  }
+
+  if(header().version == eventRecordsVersion) {
+    return readEventRecords(packed, entry.length);
+  }
+  return readEventColumns(packed, entry.length);
+}
+
+Roast SnapshotFile::readEventRecords(SnapshotRoast const& packed, std::uint64_t length) const {
+  if(length != sizeof(SnapshotRoast) + packed.eventCount * sizeof(SnapshotEvent) +
+                   packed.ingredientCount * sizeof(SnapshotIngredient)) {
+    corrupt("Roast record has the wrong length");
+  }
+
+  Roast roast{packed.id, packed.beginTimestamp};
+
+  auto const* events = reinterpret_cast<SnapshotEvent const*>(&packed + 1);
+  for(auto e = 0U; e < packed.eventCount; e++) {
+    if(events[e].hasValue) {
+      roast.addEvent(Event{readString(events[e].type), events[e].timestamp, events[e].value});
+    } else {
+      roast.addEvent(Event{readString(events[e].type), events[e].timestamp});
+    }
+  }
+
+  auto const* ingredients =
+      reinterpret_cast<SnapshotIngredient const*>(events + packed.eventCount);
+  for(auto b = 0U; b < packed.ingredientCount; b++) {
+    Bean bean{readString(ingredients[b].beanName)};
+    roast.addIngredient(Ingredient{bean, ingredients[b].amount});
+  }
+
+  return roast;
+}
+
+Roast SnapshotFile::readEventColumns(SnapshotRoast const& packed, std::uint64_t length) const {
+  auto fixedLength = sizeof(SnapshotRoast) + sizeof(SnapshotEventColumns);
+  if(length < fixedLength) {
+    corrupt("Roast record is too small");
+  }
+  auto const& columns = *reinterpret_cast<SnapshotEventColumns const*>(&packed + 1);
+  auto columnsLength = columns.timestampsLength + columns.codesLength + columns.valuesLength;
+  if(columns.timestampsLength > length || columns.codesLength > length ||
+     columns.valuesLength > length ||
+     length != fixedLength + columns.typeCount * sizeof(SnapshotString) +
+                   packed.ingredientCount * sizeof(SnapshotIngredient) +
+                   paddedLength(columnsLength)) {
+    corrupt("Roast record has the wrong length");
+  }
+
+  auto const* typeNames = reinterpret_cast<SnapshotString const*>(&columns + 1);
+  std::vector<std::string> types;
+  types.reserve(columns.typeCount);
+  for(auto t = 0U; t < columns.typeCount; t++) {
+    types.push_back(readString(typeNames[t]));
+  }
+
+  auto const* ingredients =
+      reinterpret_cast<SnapshotIngredient const*>(typeNames + columns.typeCount);
+  auto const* timestamps =
+      reinterpret_cast<std::uint8_t const*>(ingredients + packed.ingredientCount);
+  auto const* codes = timestamps + columns.timestampsLength;
+  auto const* values = codes + columns.codesLength;
+
+  auto events = EventSeries::fromColumns(
+      packed.eventCount, std::move(types), {timestamps, codes}, {codes, values},
+      {values, values + columns.valuesLength});
+  if(!events) {
+    corrupt("Malformed event columns");
+  }
+
+  Roast roast{packed.id, packed.beginTimestamp, std::move(*events)};
+  for(auto b = 0U; b < packed.ingredientCount; b++) {
+    Bean bean{readString(ingredients[b].beanName)};
+    roast.addIngredient(Ingredient{bean, ingredients[b].amount});
+  }
+
+  return roast;
+}
+
+std::vector<Bean> SnapshotFile::readBeans() const {
+  std::vector<Bean> beans;
+  beans.reserve(getBeanCount());
+  for(auto i = 0U; i < getBeanCount(); i++) {
+    beans.push_back(getBean(i));
+  }
+  return beans;
+}
+
+std::vector<Roast> SnapshotFile::readRoasts() const {
+  std::vector<Roast> roasts;
+  roasts.reserve(getRoastCount());
+  for(auto i = 0U; i < getRoastCount(); i++) {
+    roasts.push_back(getRoast(i));
+  }
+  return roasts;
+}
+
+// ==================== Index =============================
+SnapshotIndex::SnapshotIndex(std::string const& file) : mapping(file) {
+  if(mapping.getSize() < sizeof(SnapshotIndexHeader)) {
+    corrupt("Index is too small");
+  }
+  if(std::memcmp(header().magic, indexMagic, sizeof(indexMagic)) != 0) {
+    corrupt("Unknown index format");
+  }
+  if(header().version != indexVersion) {
+    corrupt("Unsupported index version");
+  }
+  if(header().entryCount >
+     (mapping.getSize() - sizeof(SnapshotIndexHeader)) / sizeof(SnapshotRoastEntry)) {
+    corrupt("Index entries out of range");
+  }
+}
+
+SnapshotIndexHeader const& SnapshotIndex::header() const {
+  return *reinterpret_cast<SnapshotIndexHeader const*>(mapping.getData());
+}
+
+bool SnapshotIndex::matches(SnapshotFile const& snapshot) const {
+  return header().generation == snapshot.getGeneration() &&
+         header().snapshotSize == snapshot.getSize() &&
+         header().entryCount == snapshot.getRoastCount();
+}
+
+SnapshotRoastEntry const* SnapshotIndex::find(long id) const {
+  auto const* begin =
+      reinterpret_cast<SnapshotRoastEntry const*>(mapping.getData() + sizeof(SnapshotIndexHeader));
+  auto const* end = begin + header().entryCount;
+
+  auto const* it = std::lower_bound(begin, end, id, [](auto const& entry, long id) {
+    return entry.id < id;
+  });
+  if(it == end || it->id != id) {
+    return nullptr;
+  }
+  return it;
+}
+
+void writeSnapshotIndex(std::string const& file, SnapshotFile const& snapshot) {
+  std::vector<SnapshotRoastEntry> entries;
+  entries.reserve(snapshot.getRoastCount());
+  for(auto i = 0U; i < snapshot.getRoastCount(); i++) {
+    entries.push_back(snapshot.getRoastEntry(i));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](auto const& a, auto const& b) { return a.id < b.id; });
+
+  SnapshotIndexHeader header{};
+  std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+  header.version = indexVersion;
+  header.generation = snapshot.getGeneration();
+  header.entryCount = entries.size();
+  header.snapshotSize = snapshot.getSize();
+
+  auto temporaryFile = file + ".tmp";
+  {
+    std::ofstream o(temporaryFile, std::ios::binary | std::ios::trunc);
+    o.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    o.write(reinterpret_cast<char const*>(entries.data()),
+            entries.size() * sizeof(SnapshotRoastEntry));
+
+    if(o.fail()) {
+      throw RoastyServerException{"Error writing database index", 500};
+    }
+  }
+
+  replaceFile(temporaryFile, file, "Error writing database index");
+}
+
+// ==================== Writing =============================
+namespace {
+
+// Collects strings for the string table, storing each distinct string once
+struct StringTable {
+  std::string bytes;
+  std::unordered_map<std::string, SnapshotString> known;
+
+  SnapshotString add(std::string const& string) {
+    auto it = known.find(string);
+    if(it != known.end()) {
+      return it->second;
+    }
+    SnapshotString reference{bytes.size(), string.size()};
+    bytes += string;
+    known.emplace(string, reference);
+    return reference;
+  }
+};
+
+template <typename T> void append(std::string& buffer, T const& value) {
+  buffer.append(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+} // namespace
+
+void writeSnapshot(std::string const& file, std::vector<Bean> const& beans,
+                   std::vector<Roast> const& roasts, std::uint32_t previousGeneration) {
+  writeSnapshot(
+      file, beans, roasts.size(), [&](size_t i) -> Roast const& { return roasts[i]; },
+      previousGeneration);
+}
+
+void writeSnapshot(std::string const& file, std::vector<Bean> const& beans, size_t roastCount,
+                   std::function<Roast const&(size_t)> const& roastAt,
+                   std::uint32_t previousGeneration) {
+  StringTable strings;
+  std::string records;
+  std::vector<SnapshotRoastEntry> entries;
+  entries.reserve(roastCount);
+
+  auto recordsOffset = sizeof(SnapshotHeader) + beans.size() * sizeof(SnapshotString) +
+                       roastCount * sizeof(SnapshotRoastEntry);
+
+  for(size_t r = 0; r < roastCount; r++) {
+    auto const& roast = roastAt(r);
+    auto offset = records.size();
+
+    SnapshotRoast packed{roast.getId(), roast.getTimestamp(),
+                         static_cast<std::uint32_t>(roast.getEventCount()),
+                         static_cast<std::uint32_t>(roast.getIngredientsCount())};
+    append(records, packed);
+
+    auto const& events = roast.getEventSeries();
+    SnapshotEventColumns columns{static_cast<std::uint32_t>(events.getTypes().size()), 0,
+                                 events.getTimestamps().size(), events.getCodes().size(),
+                                 events.getValues().size()};
+    append(records, columns);
+
+    for(auto const& type : events.getTypes()) {
+      append(records, strings.add(type));
+    }
+
+    for(auto b = 0; b < roast.getIngredientsCount(); b++) {
+      auto const& ingredient = roast.getIngredient(b);
+      SnapshotIngredient packedIngredient{ingredient.getAmount(), 0,
+                                          strings.add(ingredient.getBean().getName())};
+      append(records, packedIngredient);
+    }
+
+    // The columns are copied as they are, then padded to keep the next record aligned
+    auto columnsStart = records.size();
+    for(auto const* column : {&events.getTimestamps(), &events.getCodes(), &events.getValues()}) {
+      records.append(column->begin(), column->end());
+    }
+    records.resize(columnsStart + paddedLength(records.size() - columnsStart), '\0');
+
+    entries.push_back({roast.getId(), recordsOffset + offset, records.size() - offset});
+  }
+
+  std::vector<SnapshotString> beanNames;
+  beanNames.reserve(beans.size());
+  for(auto const& bean : beans) {
+    beanNames.push_back(strings.add(bean.getName()));
+  }
+
+  SnapshotHeader header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = currentVersion;
+  std::random_device random;
+  do {
+    header.generation = random();
+  } while(header.generation == 0 || header.generation == previousGeneration);
+  header.beanCount = beans.size();
+  header.roastCount = roastCount;
+  header.stringTableOffset = recordsOffset + records.size();
+  header.stringTableSize = strings.bytes.size();
+
+  // Write next to the target and rename over it so a crash never leaves a half written file
+  auto temporaryFile = file + ".tmp";
+  {
+    std::ofstream o(temporaryFile, std::ios::binary | std::ios::trunc);
+
+    if(o.fail()) {
+      throw RoastyServerException{"Error writing database snapshot", 500};
+    }
+
+    o.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    o.write(reinterpret_cast<char const*>(beanNames.data()),
+            beanNames.size() * sizeof(SnapshotString));
+    o.write(reinterpret_cast<char const*>(entries.data()),
+            entries.size() * sizeof(SnapshotRoastEntry));
+    o.write(records.data(), records.size());
+    o.write(strings.bytes.data(), strings.bytes.size());
+
+    if(o.fail()) {
+      throw RoastyServerException{"Error writing database snapshot", 500};
+    }
+  }
+
+  replaceFile(temporaryFile, file, "Error writing database snapshot");
+}
+
+// ==================== Conversion =============================
+void convertJsonToSnapshot(std::string const& beansJsonFile, std::string const& roastsJsonFile,
+                           std::string const& snapshotFile) {
+  std::vector<Bean> beans;
+  std::vector<Roast> roasts;
+
+  auto readJson = [](std::string const& file) {
+    std::ifstream i(file);
+    nlohmann::json j;
+    if(!i.fail()) {
+      try {
+        i >> j;
+      } catch(std::exception& e) {
+        throw RoastyServerException("Corrupt database file", 500);
+      }
+    }
+    return j;
+  };
+
+  auto beanData = readJson(beansJsonFile);
+  try {
+    for(auto& bean : beanData["beans"]) {
+      beans.emplace_back(Bean{bean.get<std::string>()});
+    }
+  } catch(std::exception& e) {
+    std::stringstream message{};
+    message << "Corrupt database file bean.json! Error while reading: " << e.what();
+    throw RoastyServerException{message.str(), 500};
+  }
+
+  std::ifstream roastData(roastsJsonFile);
+  try {
+    if(!roastData.fail()) {
+      roasts = parseRoasts(roastData);
+    }
+  } catch(std::exception& e) {
+    std::stringstream message{};
+    message << "Corrupt database file roasts.json! Error while reading: " << e.what();
+    throw RoastyServerException{message.str(), 500};
+  }
+
+  writeSnapshot(snapshotFile, beans, roasts);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "../Model/RoastyModel.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Binary snapshot of the whole database. All fields are fixed width and stored in host byte
+// order, every section is 8 byte aligned so the file can be used straight from a mapping.
+//
+//   SnapshotHeader
+//   SnapshotString[beanCount]         bean names
+//   SnapshotRoastEntry[roastCount]    offset table, one entry per roast
+//   roast records                     SnapshotRoast, then its events and ingredients
+//   string table                      bytes referenced by every SnapshotString
+//
+// Since version 2 a roast record holds the columns of its EventSeries as they are kept in memory:
+// SnapshotRoast, SnapshotEventColumns, SnapshotString[typeCount] type names,
+// SnapshotIngredient[ingredientCount], then the timestamp, code and value columns padded to 8
+// bytes. Version 1 records hold a SnapshotEvent per event instead and are still read.
+//
+// The sidecar index holds a SnapshotIndexHeader followed by the offset table sorted by roast id,
+// so a single roast can be found with a binary search and decoded on its own. Every snapshot
+// written draws a new generation, which the index copies; an index is only used with the
+// snapshot of the same generation. Version 1 indexes predate the generation and are rebuilt.
+// The write-ahead log tags its records with the generation too, see DiskStorage.
+namespace snapshot {
+
+std::uint32_t const currentVersion = 2;
+std::uint32_t const eventRecordsVersion = 1;
+std::uint32_t const indexVersion = 2;
+char const magic[8] = {'R', 'O', 'A', 'S', 'T', 'S', 'N', 'P'};
+char const indexMagic[8] = {'R', 'O', 'A', 'S', 'T', 'I', 'D', 'X'};
+
+struct SnapshotString {
+  std::uint64_t offset; // Relative to the start of the string table
+  std::uint64_t length;
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t generation; // Random, drawn anew for every snapshot written
+  std::uint64_t beanCount;
+  std::uint64_t roastCount;
+  std::uint64_t stringTableOffset;
+  std::uint64_t stringTableSize;
+};
+
+struct SnapshotRoastEntry {
+  std::int64_t id;
+  std::uint64_t offset; // Relative to the start of the file
+  std::uint64_t length;
+};
+
+struct SnapshotIndexHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t generation; // Of the snapshot the index was built from
+  std::uint64_t entryCount;
+  std::uint64_t snapshotSize; // Size of the snapshot the index was built from
+};
+
+struct SnapshotRoast {
+  std::int64_t id;
+  std::int64_t beginTimestamp;
+  std::uint32_t eventCount;
+  std::uint32_t ingredientCount;
+};
+
+struct SnapshotEvent {
+  std::int64_t timestamp;
+  std::int32_t value;
+  std::uint32_t hasValue;
+  SnapshotString type;
+};
+
+struct SnapshotEventColumns {
+  std::uint32_t typeCount;
+  std::uint32_t reserved;
+  std::uint64_t timestampsLength;
+  std::uint64_t codesLength;
+  std::uint64_t valuesLength;
+};
+
+struct SnapshotIngredient {
+  std::int32_t amount;
+  std::uint32_t reserved;
+  SnapshotString beanName;
+};
+
+} // namespace snapshot
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(std::string const& file);
+  MappedFile(MappedFile const& other) = delete;
+  MappedFile& operator=(MappedFile const& other) = delete;
+  ~MappedFile();
+
+  unsigned char const* getData() const { return data; }
+  size_t getSize() const { return size; }
+
+private:
+  unsigned char const* data = nullptr;
+  size_t size = 0;
+};
+
+// Read-only view of a snapshot file mapped into memory
+class SnapshotFile {
+public:
+  explicit SnapshotFile(std::string const& file);
+
+  size_t getSize() const { return mapping.getSize(); }
+  size_t getBeanCount() const { return header().beanCount; }
+  size_t getRoastCount() const { return header().roastCount; }
+  std::uint32_t getGeneration() const { return header().generation; }
+
+  Bean getBean(size_t i) const;
+  snapshot::SnapshotRoastEntry const& getRoastEntry(size_t i) const;
+  Roast getRoast(size_t i) const { return getRoast(getRoastEntry(i)); }
+  Roast getRoast(snapshot::SnapshotRoastEntry const& entry) const;
+
+  std::vector<Bean> readBeans() const;
+  std::vector<Roast> readRoasts() const;
+
+private:
+  MappedFile mapping;
+  unsigned char const* data;
+
+  snapshot::SnapshotHeader const& header() const;
+  std::string readString(snapshot::SnapshotString const& string) const;
+  Roast readEventRecords(snapshot::SnapshotRoast const& packed, std::uint64_t length) const;
+  Roast readEventColumns(snapshot::SnapshotRoast const& packed, std::uint64_t length) const;
+  void checkRange(std::uint64_t offset, std::uint64_t length) const;
+};
+
+// Read-only view of the sidecar index of a snapshot file
+class SnapshotIndex {
+public:
+  explicit SnapshotIndex(std::string const& file);
+
+  // False if the index was built from a different snapshot than the one given
+  bool matches(SnapshotFile const& snapshot) const;
+
+  // Returns nullptr if there is no roast with the given id
+  snapshot::SnapshotRoastEntry const* find(long id) const;
+
+private:
+  MappedFile mapping;
+
+  snapshot::SnapshotIndexHeader const& header() const;
+};
+
+// Both are written to a temporary file which is synced and renamed over the target, the rename is
+// synced before they return. The snapshot's generation is never zero nor previousGeneration.
+void writeSnapshot(std::string const& file, std::vector<Bean> const& beans,
+                   std::vector<Roast> const& roasts, std::uint32_t previousGeneration = 0);
+// Takes the roasts one at a time, so they need not all be in memory at once
+void writeSnapshot(std::string const& file, std::vector<Bean> const& beans, size_t roastCount,
+                   std::function<Roast const&(size_t)> const& roastAt,
+                   std::uint32_t previousGeneration = 0);
+
+void writeSnapshotIndex(std::string const& file, SnapshotFile const& snapshot);
+
+// Converts the json database files used before the binary snapshot was introduced
+void convertJsonToSnapshot(std::string const& beansJsonFile, std::string const& roastsJsonFile,
+                           std::string const& snapshotFile);
+
+// Flush a file, or the directory entries of the directory holding it, to stable storage
+void syncFile(std::string const& file);
+void syncDirectoryOf(std::string const& file);
@@ -0,0 +1,58 @@
+#include "../Source/Server/Compression.hpp"
+#include <catch2/catch.hpp>
+#include <string>
+#include <zlib.h>
+
+static std::string inflateBody(std::string const& compressed) {
+  z_stream stream{};
+  REQUIRE(inflateInit2(&stream, 15 + 32) == Z_OK);
+
+  std::string out(64 * 1024, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = compressed.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+  out.resize(stream.total_out);
+  inflateEnd(&stream);
+  return out;
+}
+
+TEST_CASE("Response compression") {
+  SECTION("Encoding is picked from Accept-Encoding") {
+    REQUIRE(acceptedEncoding("") == ContentEncoding::Identity);
+    REQUIRE(acceptedEncoding("br") == ContentEncoding::Identity);
+    REQUIRE(acceptedEncoding("deflate, gzip;q=1.0") == ContentEncoding::Gzip);
+    REQUIRE(acceptedEncoding("deflate, gzip;q=0") == ContentEncoding::Deflate);
+    REQUIRE(acceptedEncoding("*") == ContentEncoding::Gzip);
+  }
+
+  SECTION("Compressed bodies inflate back to the original") {
+    std::string body;
+    for(auto i = 0; i < 500; i++) {
+      body += R"({"id":)" + std::to_string(i) + R"(,"timestamp":12,"type":"measurement"},)";
+    }
+
+    for(auto encoding : {ContentEncoding::Gzip, ContentEncoding::Deflate}) {
+      auto compressed = compress(body, encoding);
+      REQUIRE(compressed.size() < body.size() / 4);
+      REQUIRE(inflateBody(compressed) == body);
+    }
+    REQUIRE(static_cast<unsigned char>(compress(body, ContentEncoding::Gzip)[0]) == 0x1f);
+  }
+
+  SECTION("Streamed bodies inflate back to the whole body") {
+    StreamCompressor compressor{ContentEncoding::Gzip};
+    std::string compressed;
+    std::string body;
+    for(auto i = 0; i < 100; i++) {
+      auto piece = std::string(i * 7, 'a' + i % 26);
+      body += piece;
+      compressor.write(piece, compressed);
+    }
+    compressor.finish("end", compressed);
+    body += "end";
+
+    REQUIRE(inflateBody(compressed) == body);
+  }
+}
@@ -0,0 +1,374 @@
+#include "../Source/Storage/DiskStorage.hpp"
+#include "../Source/Storage/Snapshot.hpp"
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+static std::string makeTemporaryDirectory() {
+  char directory[] = "/tmp/roastyXXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+  return directory;
+}
+
+TEST_CASE("Disk storage write-ahead log") {
+  auto directory = makeTemporaryDirectory();
+
+  SECTION("Mutations are replayed by a new storage instance") {
+    {
+      DiskStorage storage{directory};
+      storage.addBean(Bean{"Java"});
+      storage.addRoast(Roast{1, 100});
+      storage.addRoast(Roast{2, 200});
+      storage.removeRoast(1);
+
+      Roast replacement{2, 300};
+      replacement.addEvent(Event{"measurement", 5, 180});
+      storage.replaceRoast(2, replacement);
+    }
+
+    DiskStorage reopened{directory};
+    auto& roasts = reopened.getRoasts();
+
+    REQUIRE(reopened.getBeans().size() == 1);
+    REQUIRE(reopened.getBean(0).getName() == "Java");
+    REQUIRE(roasts.size() == 1);
+    REQUIRE(roasts[0].getId() == 2);
+    REQUIRE(roasts[0].getTimestamp() == 300);
+    REQUIRE(roasts[0].getEvent(0).getValue()->getValue() == 180);
+  }
+
+  SECTION("Checkpoint folds the log into the snapshot") {
+    DiskStorage storage{directory};
+    storage.addRoast(Roast{7, 700});
+    storage.addBean(Bean{"Kenya"});
+    storage.checkpoint();
+
+    std::ifstream log(directory + "/roasty.wal");
+    std::string line;
+    REQUIRE_FALSE(std::getline(log, line));
+
+    REQUIRE(storage.getRoasts().size() == 1);
+    REQUIRE(storage.getBeans().size() == 1);
+  }
+
+  SECTION("Records a checkpoint folded in are skipped if the log was not truncated") {
+    std::string folded;
+    {
+      DiskStorage storage{directory};
+      storage.addBean(Bean{"Java"});
+      storage.renameBean(0, "Kenya");
+      storage.addBean(Bean{"Java"});
+      storage.addRoast(Roast{1, 100});
+      Roast moved{2, 100};
+      storage.replaceRoast(1, moved);
+      storage.addRoast(Roast{1, 200});
+
+      std::ifstream log(directory + "/roasty.wal");
+      folded.assign(std::istreambuf_iterator<char>(log), std::istreambuf_iterator<char>());
+      storage.checkpoint();
+    }
+    {
+      // As if the process died between writing the snapshot and truncating the log
+      std::ofstream log(directory + "/roasty.wal", std::ios::trunc);
+      log << folded;
+    }
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{3, 300});
+    }
+
+    DiskStorage reopened{directory};
+    REQUIRE(reopened.getBeans().size() == 2);
+    REQUIRE(reopened.getBean(0).getName() == "Kenya");
+    REQUIRE(reopened.getBean(1).getName() == "Java");
+    REQUIRE(reopened.getRoasts().size() == 3);
+    REQUIRE(reopened.findRoast(1)->getTimestamp() == 200);
+    REQUIRE(reopened.findRoast(2)->getTimestamp() == 100);
+    REQUIRE(reopened.findRoast(3));
+  }
+
+  SECTION("Reads are served from memory after the first load") {
+    DiskStorage storage{directory};
+    storage.addRoast(Roast{5, 500});
+    storage.checkpoint();
+    REQUIRE(storage.getRoasts().size() == 1);
+
+    std::filesystem::remove(directory + "/roasty.snapshot");
+
+    REQUIRE(storage.getRoasts().size() == 1);
+    storage.addRoast(Roast{6, 600});
+    REQUIRE(storage.getRoasts().size() == 2);
+  }
+
+  SECTION("Event and ingredient changes are logged on their own") {
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{1, 100});
+      storage.addEvent(1, Event{"measurement", 5, 180});
+      storage.addEvent(1, Event{"measurement", 6, 190});
+      storage.replaceEvent(1, 6, Event{"first crack", 7});
+      storage.removeEvent(1, 5);
+      storage.addIngredient(1, Ingredient{Bean{"Java"}, 400});
+      storage.addIngredient(1, Ingredient{Bean{"Kenya"}, 100});
+      storage.updateIngredient(1, "Java", 450);
+      storage.removeIngredient(1, "Kenya");
+    }
+
+    std::ifstream log(directory + "/roasty.wal");
+    std::string line;
+    std::getline(log, line);
+    while(std::getline(log, line)) {
+      REQUIRE(line.find("beginTimestamp") == std::string::npos);
+    }
+
+    DiskStorage reopened{directory};
+    auto const* roast = reopened.findRoast(1);
+    REQUIRE(roast->getEventCount() == 1);
+    REQUIRE(roast->getEvent(0).getType() == "first crack");
+    REQUIRE(roast->getIngredientsCount() == 1);
+    REQUIRE(roast->getIngredient(0).getAmount() == 450);
+  }
+
+  SECTION("A batch of events is logged as one record") {
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{1, 100});
+      storage.addEvents(1, {Event{"measurement", 5, 180}, Event{"measurement", 6, 190}});
+      storage.checkpoint();
+      storage.addEvents(1, {Event{"measurement", 7, 200}, Event{"first crack", 8}});
+    }
+
+    std::ifstream log(directory + "/roasty.wal");
+    std::string line;
+    auto records = 0;
+    while(std::getline(log, line)) {
+      records++;
+    }
+    REQUIRE(records == 1);
+
+    DiskStorage reopened{directory};
+    auto const* roast = reopened.findRoast(1);
+    REQUIRE(roast->getEventCount() == 4);
+    REQUIRE(roast->getEvent(3).getType() == "first crack");
+  }
+
+  SECTION("A torn final record is ignored") {
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{3, 300});
+    }
+    {
+      std::ofstream log(directory + "/roasty.wal", std::ios::app);
+      log << R"({"op":"addRoast","roast":{"id":4,"begin)";
+    }
+
+    DiskStorage reopened{directory};
+    REQUIRE(reopened.getRoasts().size() == 1);
+    REQUIRE(reopened.getRoasts()[0].getId() == 3);
+  }
+
+  SECTION("A final record without an operation is ignored by single roast reads as well") {
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{3, 300});
+      storage.checkpoint();
+      storage.addEvent(3, Event{"measurement", 5, 180});
+    }
+    {
+      std::ofstream log(directory + "/roasty.wal", std::ios::app);
+      log << R"({"id":3})" << '\n';
+    }
+
+    DiskStorage reopened{directory};
+    REQUIRE(reopened.findRoast(3)->getEventCount() == 1);
+    REQUIRE(reopened.getRoasts().size() == 1);
+  }
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Binary snapshot") {
+  auto directory = makeTemporaryDirectory();
+  auto file = directory + "/roasty.snapshot";
+
+  SECTION("Snapshot round trips beans and roasts") {
+    Roast r{9, 900};
+    r.addEvent(Event{"measurement", 10, 200});
+    r.addEvent(Event{"first crack", 20});
+    r.addIngredient(Ingredient{Bean{"Java"}, 500});
+    writeSnapshot(file, {Bean{"Java"}, Bean{"Kenya"}}, {r, Roast{10, 1000}});
+
+    SnapshotFile snapshot{file};
+    REQUIRE(snapshot.getBeanCount() == 2);
+    REQUIRE(snapshot.getBean(1).getName() == "Kenya");
+    REQUIRE(snapshot.getRoastCount() == 2);
+    REQUIRE(snapshot.getRoastEntry(1).id == 10);
+
+    auto roast = snapshot.getRoast(0);
+    REQUIRE(roast.getId() == 9);
+    REQUIRE(roast.getTimestamp() == 900);
+    REQUIRE(roast.getEventCount() == 2);
+    REQUIRE(roast.getEvent(0).getValue()->getValue() == 200);
+    REQUIRE_FALSE(roast.getEvent(1).hasValue());
+    REQUIRE(roast.getEvent(1).getType() == "first crack");
+    REQUIRE(roast.getIngredient(0).getBean().getName() == "Java");
+    REQUIRE(roast.getIngredient(0).getAmount() == 500);
+  }
+
+  SECTION("Json database files are converted") {
+    {
+      std::ofstream beans(directory + "/beans.json");
+      beans << R"({"beans": ["Java"]})";
+      std::ofstream roasts(directory + "/roasts.json");
+      roasts << R"([{"id": 4, "beginTimestamp": 40, "events": [{"type": "measurement",
+                     "timestamp": 41, "value": 180}], "beans": [{"name": "Java", "amount": 7}]}])";
+    }
+
+    DiskStorage storage{directory};
+    REQUIRE(storage.getBeans().size() == 1);
+    REQUIRE(storage.getRoasts().size() == 1);
+    REQUIRE(storage.getRoasts()[0].getEvent(0).getValue()->getValue() == 180);
+    REQUIRE(std::filesystem::exists(file));
+  }
+
+  SECTION("Single roasts are decoded through the sidecar index") {
+    {
+      DiskStorage storage{directory};
+      for(auto id = 0; id < 20; id++) {
+        storage.addRoast(Roast{id * 7, id * 100});
+      }
+      storage.checkpoint();
+    }
+    REQUIRE(std::filesystem::exists(directory + "/roasty.idx"));
+
+    DiskStorage reopened{directory};
+    REQUIRE(reopened.findRoast(49) != nullptr);
+    REQUIRE(reopened.findRoast(49)->getTimestamp() == 700);
+    REQUIRE(reopened.findRoast(50) == nullptr);
+
+    std::filesystem::remove(directory + "/roasty.idx");
+    DiskStorage withoutIndex{directory};
+    REQUIRE(withoutIndex.findRoast(133)->getTimestamp() == 1900);
+  }
+
+  SECTION("Logged records are replayed onto single roasts decoded through the index") {
+    {
+      DiskStorage storage{directory};
+      storage.addRoast(Roast{1, 100});
+      storage.addRoast(Roast{2, 200});
+      storage.checkpoint();
+      storage.addEvent(1, Event{"measurement", 5, 180});
+      storage.addIngredient(1, Ingredient{Bean{"Java"}, 400});
+      storage.removeRoast(2);
+      storage.addRoast(Roast{3, 300});
+      storage.replaceRoast(3, Roast{3, 350});
+    }
+
+    DiskStorage reopened{directory};
+    REQUIRE(reopened.findRoast(1)->getEventCount() == 1);
+    REQUIRE(reopened.findRoast(1)->getIngredient(0).getAmount() == 400);
+    REQUIRE(reopened.findRoast(2) == nullptr);
+    REQUIRE(reopened.findRoast(3)->getTimestamp() == 350);
+    REQUIRE(reopened.getRoasts().size() == 2);
+  }
+
+  SECTION("Writes to single roasts and checkpoints leave the other roasts encoded") {
+    {
+      DiskStorage storage{directory};
+      Roast untouched{2, 200};
+      untouched.addIngredient(Ingredient{Bean{"Kenya"}, 100});
+      storage.addRoast(Roast{1, 100});
+      storage.addRoast(untouched);
+      storage.addRoast(Roast{3, 300});
+      storage.checkpoint();
+    }
+    {
+      DiskStorage storage{directory};
+      storage.addEvent(1, Event{"measurement", 5, 180});
+      storage.removeRoast(3);
+      storage.addRoast(Roast{4, 400});
+      storage.addIngredient(4, Ingredient{Bean{"Java"}, 400});
+      storage.checkpoint();
+      storage.addEvent(4, Event{"measurement", 6, 190});
+
+      BeanId id{};
+      REQUIRE_FALSE(storage.getCatalog().find("Kenya", id));
+      REQUIRE(storage.findRoast(4)->getEventCount() == 1);
+    }
+
+    std::ifstream log(directory + "/roasty.wal");
+    std::string line;
+    auto records = 0;
+    while(std::getline(log, line)) {
+      records++;
+    }
+    REQUIRE(records == 1);
+
+    DiskStorage reopened{directory};
+    auto& roasts = reopened.getRoasts();
+    REQUIRE(roasts.size() == 3);
+    REQUIRE(roasts[0].getEventCount() == 1);
+    REQUIRE(roasts[1].getIngredient(0).getBean().getName() == "Kenya");
+    REQUIRE(roasts[2].getId() == 4);
+    REQUIRE(roasts[2].getIngredient(0).getAmount() == 400);
+    REQUIRE(roasts[2].getEventCount() == 1);
+  }
+
+  SECTION("Snapshots holding an event record per event are still read") {
+    using namespace snapshot;
+    std::string strings = "measurement";
+    SnapshotHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = eventRecordsVersion;
+    header.roastCount = 1;
+    header.stringTableOffset = sizeof(SnapshotHeader) + sizeof(SnapshotRoastEntry) +
+                               sizeof(SnapshotRoast) + 2 * sizeof(SnapshotEvent);
+    header.stringTableSize = strings.size();
+    SnapshotRoastEntry entry{5, sizeof(SnapshotHeader) + sizeof(SnapshotRoastEntry),
+                             sizeof(SnapshotRoast) + 2 * sizeof(SnapshotEvent)};
+    SnapshotRoast roast{5, 500, 2, 0};
+    SnapshotEvent events[] = {{20, 180, 1, {0, strings.size()}}, {10, 0, 0, {0, 4}}};
+    {
+      std::ofstream o(file, std::ios::binary);
+      o.write(reinterpret_cast<char const*>(&header), sizeof(header));
+      o.write(reinterpret_cast<char const*>(&entry), sizeof(entry));
+      o.write(reinterpret_cast<char const*>(&roast), sizeof(roast));
+      o.write(reinterpret_cast<char const*>(events), sizeof(events));
+      o << strings;
+    }
+
+    auto read = SnapshotFile{file}.getRoast(0);
+    REQUIRE(read.getEventCount() == 2);
+    REQUIRE(read.getEvent(0).getValue()->getValue() == 180);
+    REQUIRE(read.getEvent(1).getTimestamp() == 10);
+    REQUIRE(read.getEvent(1).getType() == "meas");
+  }
+
+  SECTION("An index is only used with the snapshot it was built from") {
+    writeSnapshot(file, {}, {Roast{1, 100}, Roast{2, 200}});
+    writeSnapshotIndex(directory + "/roasty.idx", SnapshotFile{file});
+
+    // Same size and roast count, only a timestamp differs
+    writeSnapshot(file, {}, {Roast{1, 100}, Roast{2, 250}});
+    SnapshotFile rewritten{file};
+    REQUIRE_FALSE(SnapshotIndex{directory + "/roasty.idx"}.matches(rewritten));
+
+    writeSnapshotIndex(directory + "/roasty.idx", rewritten);
+    REQUIRE(SnapshotIndex{directory + "/roasty.idx"}.matches(rewritten));
+  }
+
+  SECTION("Files with an unknown format are rejected") {
+    {
+      std::ofstream o(file, std::ios::binary);
+      o << std::string(128, 'x');
+    }
+
+    REQUIRE_THROWS(SnapshotFile{file});
+  }
+
+  std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,46 @@
+#include "../Source/Server/ResponseCache.hpp"
+#include <catch2/catch.hpp>
+#include <string>
+
+TEST_CASE("Response cache") {
+  ResponseCache cache{16};
+  auto renders = 0;
+  auto render = [&renders](std::string text) {
+    return [&renders, text](std::string& out) {
+      renders++;
+      out = text;
+    };
+  };
+
+  SECTION("Bodies are reused while the version stays the same") {
+    auto first = cache.get("roasts", 1, render("[1]"));
+    auto second = cache.get("roasts", 1, render("[1]"));
+
+    REQUIRE(renders == 1);
+    REQUIRE(first == second);
+    REQUIRE(*first == "[1]");
+
+    auto third = cache.get("roasts", 2, render("[1,2]"));
+    REQUIRE(renders == 2);
+    REQUIRE(*third == "[1,2]");
+    REQUIRE(cache.getSize() == 5);
+  }
+
+  SECTION("Least recently used bodies are dropped past the budget") {
+    cache.get("a", 1, render("aaaaaa"));
+    cache.get("b", 1, render("bbbbbb"));
+    cache.get("a", 1, render("aaaaaa"));
+    cache.get("c", 1, render("cccccc"));
+    REQUIRE(cache.getSize() == 12);
+
+    cache.get("a", 1, render("aaaaaa"));
+    REQUIRE(renders == 3);
+    cache.get("b", 1, render("bbbbbb"));
+    REQUIRE(renders == 4);
+  }
+
+  SECTION("Failed renders are not stored") {
+    REQUIRE_THROWS(cache.get("roast", 1, [](std::string&) { throw 1; }));
+    REQUIRE(cache.getSize() == 0);
+  }
+}
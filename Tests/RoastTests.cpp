@@ -1,5 +1,8 @@
+#include "../Source/EventAggregation.hpp"
 #include "../Source/Model/RoastyModel.hpp"
+#include "../Source/RoastMetrics.hpp"
 #include <catch2/catch.hpp>
+#include <stdexcept>
 
 TEST_CASE("Ingredient Count is Correct") {
   auto id = 1;
@@ -7,7 +10,7 @@ TEST_CASE("Ingredient Count is Correct") {
   Roast r{id, timestamp};
   for(auto i = 0; i < 20; i++) {
     auto amount = i * 10;
-    r.addIngredient(*(new Ingredient{*(new Bean{"b"}), amount}));
+    r.addIngredient(Ingredient{Bean{"b"}, amount});
   }
 
   REQUIRE(r.getIngredientsCount() == 20);
@@ -23,9 +26,170 @@ TEST_CASE("Event Count is Correct") {
   for(auto i = 0; i < 20; i++) { // NOLINT
     auto timestamp = 20 - i;     // NOLINT
     auto const* eventTypeName = "measurement";
-    r.addEvent(*(new Event{eventTypeName, timestamp}));
+    r.addEvent(Event{eventTypeName, timestamp});
   }
 
   REQUIRE(r.getEventCount() == 20);
   REQUIRE(r.getEvent(5).getTimestamp() == 15);
 }
+
+TEST_CASE("Roast copies and moves hold their own events") {
+  Roast r{1, 12345};
+  r.addEvent(Event{"measurement", 10, 180});
+  r.addIngredient(Ingredient{Bean{"b"}, 100});
+
+  Roast copy{r};
+  copy.addEvent(Event{"measurement", 20});
+  copy.removeEventByTimestamp(10);
+
+  REQUIRE(r.getEventCount() == 1);
+  REQUIRE(r.getEvent(0).getValue()->getValue() == 180);
+  REQUIRE(copy.getEventCount() == 1);
+  REQUIRE_FALSE(copy.getEvent(0).hasValue());
+
+  Roast moved{std::move(r)};
+  REQUIRE(moved.getEventCount() == 1);
+  REQUIRE(moved.getIngredient(0).getAmount() == 100);
+}
+
+TEST_CASE("Events are stored as delta encoded columns") {
+  Roast r{1, 12345};
+  std::vector<Event> added;
+  for(auto i = 0; i < 1000; i++) {
+    long timestamp = 1600000000000L + i * 250 + (i % 7 == 0 ? -100 : 0);
+    if(i % 100 == 50) {
+      added.emplace_back("first crack", timestamp);
+    } else {
+      added.emplace_back("measurement", timestamp, 180 + i / 10 - (i % 3));
+    }
+    r.addEvent(added.back());
+  }
+  r.addEvent(Event{"measurement", -5, -40});
+  added.emplace_back("measurement", -5, -40);
+
+  auto const& series = r.getEventSeries();
+  auto bytes = series.getTimestamps().size() + series.getCodes().size() +
+               series.getValues().size();
+  REQUIRE(bytes / series.size() < 6);
+
+  SECTION("Events decode in the order they were added") {
+    REQUIRE(r.getEventCount() == 1001);
+    auto decoded = r.getEvents();
+    for(auto i = 0U; i < added.size(); i++) {
+      REQUIRE(decoded[i].getTimestamp() == added[i].getTimestamp());
+      REQUIRE(decoded[i].getType() == added[i].getType());
+      REQUIRE(decoded[i].hasValue() == added[i].hasValue());
+      if(added[i].hasValue()) {
+        REQUIRE(decoded[i].getValue()->getValue() == added[i].getValue()->getValue());
+      }
+    }
+    REQUIRE(r.getEvent(999).getTimestamp() == added[999].getTimestamp());
+    REQUIRE(r.getEvent(1000).getValue()->getValue() == -40);
+    REQUIRE_THROWS_AS(r.getEvent(1001), std::out_of_range);
+    REQUIRE_THROWS_AS(r.getEvent(-1), std::out_of_range);
+    REQUIRE_THROWS_AS(Roast(2, 0).getEvent(0), std::out_of_range);
+    REQUIRE(r.findEvent(added[450].getTimestamp())->getType() == "first crack");
+    REQUIRE_FALSE(r.findEvent(3));
+  }
+
+  SECTION("Removing an event keeps the others in order") {
+    r.removeEventByTimestamp(added[10].getTimestamp());
+    REQUIRE(r.getEventCount() == 1000);
+    REQUIRE(r.getEvent(9).getTimestamp() == added[9].getTimestamp());
+    REQUIRE(r.getEvent(10).getTimestamp() == added[11].getTimestamp());
+    REQUIRE(r.getEvent(999).getTimestamp() == -5);
+  }
+
+  SECTION("Removing events encodes the series again from their block on") {
+    std::vector<Event> remaining = added;
+    for(auto i : {999, 640, 32, 31, 0}) {
+      r.removeEventByTimestamp(added[i].getTimestamp());
+      remaining.erase(remaining.begin() + i);
+    }
+    REQUIRE_FALSE(r.findEvent(added[31].getTimestamp()));
+    REQUIRE(r.findEvent(added[33].getTimestamp()));
+    REQUIRE(r.findEvent(-5)->getValue()->getValue() == -40);
+
+    auto decoded = r.getEvents();
+    REQUIRE(decoded.size() == remaining.size());
+    for(auto i = 0U; i < remaining.size(); i++) {
+      REQUIRE(decoded[i].getTimestamp() == remaining[i].getTimestamp());
+      REQUIRE(decoded[i].hasValue() == remaining[i].hasValue());
+    }
+    REQUIRE(EventSeries::fromColumns(series.size(), series.getTypes(), series.getTimestamps(),
+                                     series.getCodes(), series.getValues()));
+  }
+
+  SECTION("Series are rebuilt from their columns") {
+    auto copy = EventSeries::fromColumns(series.size(), series.getTypes(), series.getTimestamps(),
+                                         series.getCodes(), series.getValues());
+    REQUIRE(copy);
+    REQUIRE(copy->get(640).getTimestamp() == added[640].getTimestamp());
+    copy->append(Event{"drop", 1700000000000L});
+    REQUIRE(copy->get(1001).getType() == "drop");
+
+    auto truncated = series.getValues();
+    truncated.pop_back();
+    REQUIRE_FALSE(EventSeries::fromColumns(series.size(), series.getTypes(),
+                                           series.getTimestamps(), series.getCodes(), truncated));
+    REQUIRE_FALSE(EventSeries::fromColumns(series.size(), {}, series.getTimestamps(),
+                                           series.getCodes(), series.getValues()));
+  }
+}
+
+TEST_CASE("Event values are aggregated over windows") {
+  Roast r{1, 0};
+  r.addEvent(Event{"charge", 0});
+  for(auto t = 0; t < 10000; t += 500) {
+    r.addEvent(Event{"measurement", t, 100 + t / 100});
+  }
+  r.addEvent(Event{"fan", 2500, 80});
+  r.addEvent(Event{"measurement", -1000, 90});
+
+  auto buckets = aggregateEvents(r.getEventSeries(), 5000, std::string{"measurement"});
+  REQUIRE(buckets.size() == 3);
+  REQUIRE(buckets[0].start == -5000);
+  REQUIRE(buckets[0].count == 1);
+  REQUIRE(buckets[1].start == 0);
+  REQUIRE(buckets[1].count == 10);
+  REQUIRE(buckets[1].min == 100);
+  REQUIRE(buckets[1].max == 145);
+  REQUIRE(buckets[1].avg == Approx(122.5));
+  REQUIRE(buckets[2].min == 150);
+
+  auto all = aggregateEvents(r.getEventSeries(), 5000);
+  REQUIRE(all[1].count == 11);
+  REQUIRE(all[1].min == 80);
+
+  REQUIRE(aggregateEvents(r.getEventSeries(), 5000, std::string{"drop"}).empty());
+}
+
+TEST_CASE("Metrics are derived from the events of a roast") {
+  Roast r{1, 0};
+  r.addEvent(Event{"fill", 1000, 0});
+  for(auto t = 0; t <= 600000; t += 2000) {
+    r.addEvent(Event{"reading", t, 100 + t / 6000}); // 10 degrees a minute
+  }
+  r.addEvent(Event{"browning", 241000, 0});
+  r.addEvent(Event{"crack", 481000, 0});
+  r.addEvent(Event{"drop", 601000, 0});
+
+  auto metrics = computeMetrics(r.getEventSeries(), 30000);
+  REQUIRE(*metrics.dryingTime == 240000);
+  REQUIRE(*metrics.maillardTime == 240000);
+  REQUIRE(*metrics.developmentTime == 120000);
+  REQUIRE(*metrics.totalTime == 600000);
+  REQUIRE(*metrics.developmentRatio == Approx(0.2));
+
+  REQUIRE(metrics.readingCount == 301);
+  REQUIRE(*metrics.minTemperature == 100);
+  REQUIRE(*metrics.maxTemperature == 200);
+  REQUIRE(metrics.rateOfRise.size() == 300);
+  REQUIRE(metrics.rateOfRise.front().timestamp == 2000);
+  REQUIRE(metrics.rateOfRise[150].value == Approx(10).margin(0.5));
+
+  auto none = computeMetrics(Roast{2, 0}.getEventSeries(), 30000);
+  REQUIRE_FALSE(none.totalTime);
+  REQUIRE(none.readingCount == 0);
+  REQUIRE(none.rateOfRise.empty());
+}
@@ -6,6 +6,7 @@ using namespace std;
 #include "../Source/Server/RoastyServerException.hpp"
 #include "../Source/Storage/MemoryStorage.hpp"
 #include "../Source/Utilities.hpp"
+#include <thread>
 
 TEST_CASE("Bean can be CRUD") {
   MemoryStorage storage;
@@ -25,7 +26,7 @@ TEST_CASE("Bean can be CRUD") {
 
   SECTION("Removing bean works") {
     Bean b{"Other bean"};
-    storage.beans.push_back(b);
+    storage.addBean(b);
     roasty.deleteBean(b);
 
     auto it = std::find_if(storage.beans.begin(), storage.beans.end(),
@@ -33,6 +34,67 @@ TEST_CASE("Bean can be CRUD") {
 
     REQUIRE(it == storage.beans.end());
   }
+
+  SECTION("Renaming bean cascades into roasts") {
+    roasty.addBean(Bean{"Sumatra"});
+    roasty.addBean(Bean{"Yirgacheffe"});
+    Roast r{4242, 10};
+    r.addIngredient(Ingredient{Bean{"Sumatra"}, 250});
+    roasty.addRoast(r);
+
+    roasty.renameBean(Bean{"Sumatra"}, "Sumatra Mandheling");
+
+    REQUIRE(storage.getBean(0).getName() == "Sumatra Mandheling");
+    REQUIRE(roasty.getRoast(4242).getIngredient(0).getBean().getName() == "Sumatra Mandheling");
+    REQUIRE(roasty.getIngredientByBeanName(4242, "Sumatra Mandheling").getAmount() == 250);
+    REQUIRE_THROWS(roasty.getIngredientByBeanName(4242, "Sumatra"));
+    REQUIRE_THROWS(roasty.renameBean(Bean{"Yirgacheffe"}, "Sumatra Mandheling"));
+    REQUIRE_THROWS(roasty.addBean(Bean{"Yirgacheffe"}));
+  }
+
+  SECTION("Renames are only checked against the current beans") {
+    roasty.addBean(Bean{"Harrar"});
+    roasty.addBean(Bean{"Bourbon"});
+    roasty.deleteBean(Bean{"Bourbon"});
+    roasty.deleteBean(Bean{"Pacamara"});
+
+    roasty.renameBean(Bean{"Harrar"}, "Bourbon");
+    roasty.renameBean(Bean{"Bourbon"}, "Pacamara");
+
+    REQUIRE(storage.getBean(0).getName() == "Pacamara");
+    BeanId id;
+    REQUIRE_FALSE(storage.getCatalog().find("Bourbon", id));
+    REQUIRE_FALSE(storage.getCatalog().find("Harrar", id));
+  }
+
+  SECTION("Beans cannot be renamed to a name ingredients use") {
+    roasty.addBean(Bean{"Ruiru"});
+    Roast withName{1, 10};
+    withName.addIngredient(Ingredient{Bean{"Batian"}, 100});
+    roasty.addRoast(withName);
+    Roast withBean{2, 20};
+    withBean.addIngredient(Ingredient{Bean{"Ruiru"}, 100});
+    roasty.addRoast(withBean);
+
+    REQUIRE_THROWS(roasty.renameBean(Bean{"Ruiru"}, "Batian"));
+    REQUIRE(storage.getBean(0).getName() == "Ruiru");
+
+    RoastFilter filter;
+    filter.bean = "Batian";
+    REQUIRE(roasty.findRoasts(filter).roasts.size() == 1);
+  }
+
+  SECTION("Every storage has a catalog of its own") {
+    MemoryStorage otherStorage;
+    Roasty<MemoryStorage> other{&otherStorage};
+    roasty.addBean(Bean{"Catuai"});
+    other.addBean(Bean{"Catuai"});
+
+    roasty.renameBean(Bean{"Catuai"}, "Red Catuai");
+
+    REQUIRE(storage.getBean(0).getName() == "Red Catuai");
+    REQUIRE(otherStorage.getBean(0).getName() == "Catuai");
+  }
 }
 
 TEST_CASE("Roasts can be CRUD") {
@@ -52,7 +114,7 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Deleting a roast works") {
     Roast r{1, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     roasty.deleteRoast(r.getId());
 
@@ -64,11 +126,10 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Adding an event to a roast works") {
     Roast r{12, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
-    auto& eNoValue = *(new Event{"measurement", 12345});
-    auto* v = new EventValue{200};
-    auto& eWithValue = *(new Event{"measurement", 123456, v});
+    Event eNoValue{"measurement", 12345};
+    Event eWithValue{"measurement", 123456, 200};
 
     roasty.addEventToRoast(12, eNoValue);
     roasty.addEventToRoast(12, eWithValue);
@@ -91,8 +152,8 @@ TEST_CASE("Roasts can be CRUD") {
   SECTION("Getting all roasts works") {
     Roast r1{15, 50};
     Roast r2{16, 60};
-    storage.roasts.push_back(r1);
-    storage.roasts.push_back(r2);
+    storage.addRoast(r1);
+    storage.addRoast(r2);
 
     auto allRoasts = roasty.allRoasts();
 
@@ -109,23 +170,23 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Getting a roast works") {
     Roast r{55, 65};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
-    auto& foundRoast = roasty.getRoast(55);
+    auto foundRoast = roasty.getRoast(55);
 
     REQUIRE(foundRoast.getId() == 55);
   }
 
   SECTION("Deleting an event from a roast works") {
     Roast r{1237, 5678};
-    auto& e = *(new Event{"measurement", 123459});
+    Event e{"measurement", 123459};
     r.addEvent(e);
     REQUIRE(r.getEventCount() > 0);
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     roasty.removeEventFromRoast(1237, 123459);
 
-    auto& newRoast = roasty.getRoast(1237);
+    auto newRoast = roasty.getRoast(1237);
 
     REQUIRE(newRoast.getEventCount() == 0);
   }
@@ -134,7 +195,7 @@ TEST_CASE("Roasts can be CRUD") {
     Roast oldR{88, 1};
     Roast newR{99, 2};
 
-    storage.roasts.push_back(oldR);
+    storage.addRoast(oldR);
 
     roasty.replaceRoast(88, newR);
 
@@ -150,36 +211,35 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Replacing an event in a roast works") {
     Roast r{1235, 5124};
-    auto& oldE = *(new Event{"measurement", 123459});
-    auto& newE = *(new Event{"measurement", 100000});
+    Event oldE{"measurement", 123459};
+    Event newE{"measurement", 100000};
 
     r.addEvent(oldE);
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     roasty.replaceEventInRoast(1235, 123459, newE);
 
-    auto newRoast = roasty.getRoast(1235);
+    auto newEvents = roasty.getRoast(1235).getEvents();
     auto events = RangeGenerator<const Event>(
-        [&newRoast](auto i) -> Event const& { return newRoast.getEvent(i); },
-        newRoast.getEventCount());
+        [&newEvents](auto i) -> Event const& { return newEvents[i]; }, newEvents.size());
 
     auto it = std::find_if(events.begin(), events.end(),
                            [&](const auto& event) { return event.getTimestamp() == 100000; });
 
     REQUIRE(it != events.end());
     REQUIRE(it->getTimestamp() == 100000);
-    storage.roasts.clear();
+    storage.setRoasts({});
   }
 
   SECTION("Adding a blend to a roast works") {
     Roast r{1111, 5124};
-    auto& javaBean = *(new Bean{"Java"});
-    auto& b = *(new Ingredient{javaBean, 400});
-    storage.roasts.push_back(r);
+    Bean javaBean{"Java"};
+    Ingredient b{javaBean, 400};
+    storage.addRoast(r);
 
     roasty.addIngredientToRoast(1111, b);
 
-    auto& newRoast = roasty.getRoast(1111);
+    auto newRoast = roasty.getRoast(1111);
     auto bean = RangeGenerator<const Ingredient>(
         [&newRoast](auto i) -> Ingredient const& { return newRoast.getIngredient(i); },
         newRoast.getIngredientsCount());
@@ -194,14 +254,14 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Deleting a blend from a roast works") {
     Roast r{1112, 5123};
-    auto& b = *(new Ingredient{*(new Bean{"Java"}), 500});
+    Ingredient b{Bean{"Java"}, 500};
     r.addIngredient(b);
 
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     roasty.removeIngredientFromRoast(1112, "Java");
 
-    auto& newRoast = roasty.getRoast(1112);
+    auto newRoast = roasty.getRoast(1112);
     auto bean = RangeGenerator<Ingredient const* const>(
         [&newRoast](auto i) -> Ingredient const* const { return &newRoast.getIngredient(i); },
         newRoast.getIngredientsCount());
@@ -214,41 +274,321 @@ TEST_CASE("Roasts can be CRUD") {
 
   SECTION("Updating a blend from a roast works") {
     Roast r{1113, 5123};
-    auto* javaBean = new Bean{"Java"};
-    auto* b = new Ingredient{*javaBean, 300};
-    r.addIngredient(*b);
+    Bean javaBean{"Java"};
+    Ingredient b{javaBean, 300};
+    r.addIngredient(b);
 
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     roasty.updateIngredient(1113, "Java", 500);
 
-    auto& newRoast = roasty.getRoast(1113);
+    auto newRoast = roasty.getRoast(1113);
 
     REQUIRE(newRoast.getIngredientsCount() == 1);
     REQUIRE(newRoast.getIngredient(0).getAmount() == 500);
   }
 }
 
+TEST_CASE("Roast id index stays in step with storage") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+
+  for(auto id = 0; id < 10; id++) {
+    roasty.addRoast(Roast{id, id * 10});
+  }
+
+  roasty.deleteRoast(3);
+  REQUIRE_THROWS(roasty.getRoast(3));
+  REQUIRE(roasty.getRoast(9).getTimestamp() == 90);
+
+  roasty.replaceRoast(4, Roast{40, 400});
+  REQUIRE_THROWS(roasty.getRoast(4));
+  REQUIRE(roasty.getRoast(40).getTimestamp() == 400);
+  REQUIRE_THROWS(roasty.addRoast(Roast{40, 1}));
+
+  // A vector changed behind the storage's back is only found again after a rebuild
+  storage.roasts.erase(storage.roasts.begin());
+  storage.roasts.push_back(Roast{77, 770});
+  storage.roastIndex.rebuild(storage.roasts);
+  REQUIRE_THROWS(roasty.getRoast(0));
+  REQUIRE(roasty.getRoast(77).getTimestamp() == 770);
+  REQUIRE(roasty.getRoast(9).getTimestamp() == 90);
+}
+
+TEST_CASE("Roast snapshots are immutable") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  roasty.addRoast(Roast{1, 10});
+
+  auto before = roasty.roastsSnapshot();
+  REQUIRE(roasty.roastsSnapshot().roasts == before.roasts);
+  REQUIRE(before.version == roasty.roastsVersion());
+
+  roasty.addRoast(Roast{2, 20});
+  auto added = roasty.roastsSnapshot();
+  REQUIRE(added.roasts->at(0) == before.roasts->at(0));
+
+  roasty.addEventToRoast(1, Event{"measurement", 5, 180});
+  auto after = roasty.roastsSnapshot();
+
+  REQUIRE(after.version == roasty.roastsVersion());
+  REQUIRE(after.version != before.version);
+  REQUIRE(before.roasts->size() == 1);
+  REQUIRE(before.roasts->at(0)->getEventCount() == 0);
+  REQUIRE(after.roasts->size() == 2);
+  REQUIRE(after.roasts->at(0)->getEventCount() == 1);
+  REQUIRE(after.roasts->at(1) == added.roasts->at(1));
+}
+
+TEST_CASE("Roasts are paged and filtered") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  for(auto id = 1; id <= 10; id++) {
+    Roast roast{id, (11 - id) * 10};
+    roast.addIngredient(Ingredient{Bean{id % 2 == 0 ? "Java" : "Kenya"}, 100});
+    roasty.addRoast(roast);
+  }
+  roasty.addRoast(Roast{11, 50});
+
+  SECTION("Pages follow the cursor in order of beginTimestamp") {
+    RoastFilter filter;
+    filter.limit = 4;
+    auto first = roasty.findRoasts(filter);
+    REQUIRE(first.roasts.size() == 4);
+    REQUIRE(first.roasts[0]->getId() == 10);
+    REQUIRE(first.roasts[3]->getId() == 7);
+    REQUIRE(first.next);
+
+    filter.after = first.next;
+    auto second = roasty.findRoasts(filter);
+    REQUIRE(second.roasts[0]->getId() == 6);
+
+    filter.after = second.next;
+    auto third = roasty.findRoasts(filter);
+    REQUIRE(third.roasts.size() == 3);
+    REQUIRE(third.roasts[2]->getId() == 1);
+    REQUIRE_FALSE(third.next);
+  }
+
+  SECTION("Timestamp range") {
+    RoastFilter filter;
+    filter.from = 30;
+    filter.to = 60;
+    auto page = roasty.findRoasts(filter);
+    REQUIRE(page.roasts.size() == 4);
+    REQUIRE(page.roasts[0]->getId() == 8);
+    REQUIRE(page.roasts[3]->getId() == 11);
+  }
+
+  SECTION("Bean filter") {
+    RoastFilter filter;
+    filter.bean = "Java";
+    filter.limit = 2;
+    auto page = roasty.findRoasts(filter);
+    REQUIRE(page.roasts.size() == 2);
+    REQUIRE(page.roasts[0]->getId() == 10);
+    REQUIRE(page.roasts[1]->getId() == 8);
+
+    filter.bean = "Unknown";
+    REQUIRE(roasty.findRoasts(filter).roasts.empty());
+  }
+
+  SECTION("Pages see later writes") {
+    RoastFilter filter;
+    filter.from = 200;
+    REQUIRE(roasty.findRoasts(filter).roasts.empty());
+    roasty.addRoast(Roast{12, 200});
+    auto page = roasty.findRoasts(filter);
+    REQUIRE(page.roasts.size() == 1);
+    REQUIRE(page.version == roasty.roastsVersion());
+  }
+
+  SECTION("Pages after a write are found in the index of the version before") {
+    RoastFilter filter;
+    filter.bean = "Java";
+    REQUIRE(roasty.findRoasts(filter).roasts.size() == 5);
+
+    Roast moved{4, 5};
+    moved.addIngredient(Ingredient{Bean{"Kenya"}, 100});
+    roasty.replaceRoast(4, moved);
+    roasty.deleteRoast(10);
+    roasty.addEventToRoast(2, Event{"measurement", 5, 180});
+
+    auto java = roasty.findRoasts(filter);
+    REQUIRE(java.roasts.size() == 3);
+    REQUIRE(java.roasts[0]->getId() == 8);
+    REQUIRE(java.roasts[2]->getId() == 2);
+    REQUIRE(java.roasts[2]->getEventCount() == 1);
+
+    filter.bean = "Kenya";
+    auto kenya = roasty.findRoasts(filter);
+    REQUIRE(kenya.roasts.size() == 6);
+    REQUIRE(kenya.roasts[0]->getId() == 4);
+
+    filter.bean.reset();
+    auto all = roasty.findRoasts(filter);
+    REQUIRE(all.roasts.size() == 10);
+    REQUIRE(all.roasts[0]->getId() == 4);
+  }
+}
+
+TEST_CASE("Events are added in batches") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  roasty.addRoast(Roast{1, 10});
+  roasty.addEventToRoast(1, Event{"measurement", 5, 180});
+
+  std::vector<Event> batch;
+  for(auto timestamp = 6; timestamp < 1006; timestamp++) {
+    batch.emplace_back("measurement", timestamp, 180 + timestamp / 10);
+  }
+  auto version = roasty.roastVersion(1);
+  roasty.addEventsToRoast(1, batch);
+  REQUIRE(roasty.getRoast(1).getEventCount() == 1001);
+  REQUIRE(roasty.roastVersion(1) != version);
+
+  SECTION("Batches clashing with the roast or themselves are rejected whole") {
+    REQUIRE_THROWS_AS(roasty.addEventsToRoast(1, {Event{"measurement", 2000, 1},
+                                                  Event{"measurement", 5, 1}}),
+                      RoastyServerException);
+    REQUIRE_THROWS_AS(roasty.addEventsToRoast(1, {Event{"measurement", 2000, 1},
+                                                  Event{"measurement", 2000, 2}}),
+                      RoastyServerException);
+    REQUIRE(roasty.getRoast(1).getEventCount() == 1001);
+  }
+}
+
+TEST_CASE("Versions change with the data they cover") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  roasty.addRoast(Roast{1, 10});
+  roasty.addRoast(Roast{2, 20});
+
+  auto all = roasty.roastsVersion();
+  auto first = roasty.roastVersion(1);
+  auto second = roasty.roastVersion(2);
+  auto beans = roasty.beansVersion();
+
+  roasty.addEventToRoast(2, Event{"measurement", 5, 180});
+  REQUIRE(roasty.roastsVersion() != all);
+  REQUIRE(roasty.roastVersion(1) == first);
+  REQUIRE(roasty.roastVersion(2) != second);
+  REQUIRE(roasty.beansVersion() == beans);
+
+  auto current = roasty.getVersionedRoast(2);
+  REQUIRE(current.version == roasty.roastVersion(2));
+  REQUIRE(current.roast.getEventCount() == 1);
+  REQUIRE_THROWS(roasty.getVersionedRoast(3));
+
+  roasty.addBean(Bean{"Version Bean"});
+  REQUIRE(roasty.beansVersion() != beans);
+  REQUIRE(roasty.roastVersion(1) == first);
+
+  roasty.renameBean(Bean{"Version Bean"}, "Renamed Version Bean");
+  REQUIRE(roasty.roastVersion(1) != first);
+}
+
+TEST_CASE("Conditional writes check the version") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  roasty.addRoast(Roast{1, 10});
+  roasty.addIngredientToRoast(1, Ingredient{Bean{"Conditional Bean"}, 5});
+
+  auto version = roasty.roastVersion(1);
+  WriteCondition stale{true, {version - 1}};
+  WriteCondition current{true, {version - 1, version}};
+
+  try {
+    roasty.updateIngredient(1, "Conditional Bean", 6, stale);
+    FAIL("Stale write was accepted");
+  } catch(RoastyServerException& e) {
+    REQUIRE(e.status == 412);
+  }
+  REQUIRE(roasty.getRoast(1).getIngredient(0).getAmount() == 5);
+
+  roasty.updateIngredient(1, "Conditional Bean", 7, current);
+  REQUIRE(roasty.getRoast(1).getIngredient(0).getAmount() == 7);
+  REQUIRE_THROWS(roasty.replaceRoast(1, Roast{1, 20}, current));
+  REQUIRE_THROWS(roasty.replaceEventInRoast(1, 0, Event{"measurement", 1}, current));
+  roasty.replaceRoast(1, Roast{1, 20}, WriteCondition{true, {roasty.roastVersion(1)}});
+  REQUIRE(roasty.getRoast(1).getTimestamp() == 20);
+}
+
+TEST_CASE("Concurrent readers and writers") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  roasty.addRoast(Roast{1, 0});
+
+  std::vector<std::thread> threads;
+  for(auto t = 0; t < 4; t++) {
+    threads.emplace_back([&roasty, t] {
+      for(auto i = 0; i < 100; i++) {
+        roasty.addEventToRoast(1, Event{"measurement", t * 100 + i, i});
+        roasty.addRoast(Roast{t * 100 + i + 2, i});
+        roasty.getRoast(1).getEventCount();
+        roasty.allRoasts();
+        auto snapshot = roasty.roastsSnapshot();
+        for(auto const& roast : *snapshot.roasts) {
+          roast->getEventCount();
+        }
+      }
+    });
+  }
+  for(auto& thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(roasty.getRoast(1).getEventCount() == 400);
+  REQUIRE(roasty.allRoasts().size() == 401);
+}
+
 TEST_CASE("Error handling") {
   MemoryStorage storage;
   Roasty<MemoryStorage> roasty{&storage};
 
   SECTION("Cannot add duplicate event") {
     Roast r{12, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
-    auto& e1 = *(new Event{"measurement", 12345});
-    auto& e2 = *(new Event{"measurement", 12345});
+    Event e1{"measurement", 12345};
+    Event e2{"measurement", 12345};
 
     roasty.addEventToRoast(12, e1);
 
     REQUIRE_THROWS(roasty.addEventToRoast(12, e2));
-    delete &e2;
+  }
+
+  SECTION("Cannot replace an event with one whose timestamp is taken") {
+    Roast r{12, 50};
+    r.addEvent(Event{"measurement", 100, 1});
+    r.addEvent(Event{"measurement", 200, 2});
+    storage.addRoast(r);
+
+    REQUIRE_THROWS(roasty.replaceEventInRoast(12, 100, Event{"measurement", 200, 3}));
+    REQUIRE(roasty.getRoast(12).getEventCount() == 2);
+    REQUIRE(roasty.getEventById(12, 100).getValue()->getValue() == 1);
+    REQUIRE(roasty.getEventById(12, 200).getValue()->getValue() == 2);
+
+    roasty.replaceEventInRoast(12, 100, Event{"measurement", 100, 4});
+    REQUIRE(roasty.getEventById(12, 100).getValue()->getValue() == 4);
+  }
+
+  SECTION("Cannot replace a roast with one whose id is taken") {
+    roasty.addRoast(Roast{1, 10});
+    roasty.addRoast(Roast{2, 20});
+
+    REQUIRE_THROWS(roasty.replaceRoast(2, Roast{1, 99}));
+    REQUIRE(roasty.getRoast(1).getTimestamp() == 10);
+    REQUIRE(roasty.getRoast(2).getTimestamp() == 20);
+    REQUIRE(roasty.allRoasts().size() == 2);
+
+    roasty.replaceRoast(2, Roast{2, 30});
+    REQUIRE(roasty.getRoast(2).getTimestamp() == 30);
   }
 
   SECTION("Cannot add event to nonexistent roast") {
     Roast r{12, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
     Event e1{"measurement", 12345};
 
@@ -257,27 +597,125 @@ TEST_CASE("Error handling") {
 
   SECTION("Cannot add duplicate ingredient") {
     Roast r{12, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
-    auto& b = *(new Ingredient{*(new Bean{"Java"}), 400});
-    auto& b2 = *(new Ingredient{*(new Bean{"Java"}), 400});
+    Ingredient b{Bean{"Java"}, 400};
+    Ingredient b2{Bean{"Java"}, 400};
 
     roasty.addIngredientToRoast(12, b);
 
     REQUIRE_THROWS(roasty.addIngredientToRoast(12, b2));
-    delete &b2;
   }
 
   SECTION("Cannot add event to nonexistent roast") {
     Roast r{12, 50};
-    storage.roasts.push_back(r);
+    storage.addRoast(r);
 
-    auto& b = *(new Ingredient{*(new Bean{"Java"}), 400});
-    auto& b2 = *(new Ingredient{*(new Bean{"Java"}), 400});
+    Ingredient b2{Bean{"Java"}, 400};
 
     REQUIRE_THROWS(roasty.addIngredientToRoast(300, b2));
-    delete &b2;
-    delete &b;
   }
-  storage.getRoasts().clear();
+  storage.setRoasts({});
+}
+
+TEST_CASE("Roasts with similar curves are found") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+
+  auto addRoast = [&roasty](long id, long degreesPerMinute, long minutes) {
+    roasty.addRoast(Roast{id, 0});
+    std::vector<Event> readings;
+    for(long t = 0; t <= minutes * 60000; t += 5000) {
+      readings.emplace_back("reading", t, 100 + static_cast<int>(degreesPerMinute * t / 60000));
+    }
+    roasty.addEventsToRoast(id, readings);
+  };
+  for(auto id = 1; id <= 20; id++) {
+    addRoast(id, id, 12);
+  }
+  roasty.addRoast(Roast{100, 0});
+
+  auto similar = roasty.similarRoasts(10, 4);
+  REQUIRE(similar.size() == 4);
+  REQUIRE(similar[0].distance <= similar[1].distance);
+  REQUIRE(((similar[0].id == 9 && similar[1].id == 11) ||
+           (similar[0].id == 11 && similar[1].id == 9)));
+  REQUIRE(roasty.similarRoasts(10, 100).size() == 19);
+  REQUIRE(roasty.similarRoasts(100, 5).empty());
+
+  SECTION("A roast in progress is compared over its own length") {
+    addRoast(50, 7, 2);
+    auto early = roasty.similarRoasts(50, 1);
+    REQUIRE(early[0].id == 7);
+    REQUIRE(early[0].distance < 1);
+
+    // Readings posted one by one are fingerprinted once, by the next search
+    for(long t = 125000; t <= 12 * 60000; t += 5000) {
+      roasty.addEventToRoast(50, Event{"reading", t, 100 + static_cast<int>(7 * t / 60000)});
+    }
+    auto finished = roasty.similarRoasts(50, 2);
+    REQUIRE(finished[0].id == 7);
+    REQUIRE(finished[0].distance < 1);
+    REQUIRE(finished[1].distance > 5);
+  }
+
+  SECTION("Writes keep the index in step") {
+    roasty.deleteRoast(11);
+    roasty.addEventToRoast(100, Event{"reading", 0, 100});
+    auto after = roasty.similarRoasts(10, 2);
+    REQUIRE(after[0].id == 9);
+    REQUIRE(after[1].id != 11);
+    REQUIRE(roasty.similarRoasts(100, 25).size() == 19);
+  }
+}
+
+TEST_CASE("Bean usage is kept up to date by roast writes") {
+  MemoryStorage storage;
+  Roasty<MemoryStorage> roasty{&storage};
+  auto const day = BeanUsageIndex::dayLength;
+
+  Roast first{1, 10 * day + 100};
+  first.addIngredient(Ingredient{Bean{"Java"}, 400});
+  first.addIngredient(Ingredient{Bean{"Kenya"}, 100});
+  roasty.addRoast(first);
+  roasty.addRoast(Roast{2, 12 * day});
+  roasty.addIngredientToRoast(2, Ingredient{Bean{"Java"}, 250});
+
+  auto all = roasty.beanUsage(std::nullopt, std::nullopt, std::nullopt);
+  REQUIRE(all.size() == 2);
+  REQUIRE(all[0].name == "Java");
+  REQUIRE(all[0].total.amount == 650);
+  REQUIRE(all[0].total.roasts == 2);
+  REQUIRE(all[0].days.empty());
+
+  SECTION("Ingredient changes and deletes are reflected") {
+    roasty.updateIngredient(1, "Java", 300);
+    roasty.removeIngredientFromRoast(1, "Kenya");
+    roasty.addRoast(Roast{3, 12 * day + 5});
+    roasty.addIngredientToRoast(3, Ingredient{Bean{"Java"}, 50});
+    roasty.deleteRoast(2);
+
+    auto java = roasty.beanUsage(std::string{"Java"}, std::nullopt, std::nullopt);
+    REQUIRE(java.size() == 1);
+    REQUIRE(java[0].total.amount == 350);
+    REQUIRE(java[0].total.roasts == 2);
+    REQUIRE(roasty.beanUsage(std::string{"Kenya"}, std::nullopt, std::nullopt).empty());
+  }
+
+  SECTION("Ranges report the days in them") {
+    auto range = roasty.beanUsage(std::string{"Java"}, 11 * day, 13 * day);
+    REQUIRE(range.size() == 1);
+    REQUIRE(range[0].total.amount == 250);
+    REQUIRE(range[0].days.size() == 1);
+    REQUIRE(range[0].days[0].first == 12 * day);
+  }
+
+  SECTION("Renamed beans keep their usage") {
+    roasty.addBean(Bean{"Sidamo"});
+    roasty.addIngredientToRoast(2, Ingredient{Bean{"Sidamo"}, 80});
+    roasty.renameBean(Bean{"Sidamo"}, "Sidamo Natural");
+    auto renamed = roasty.beanUsage(std::string{"Sidamo Natural"}, std::nullopt, std::nullopt);
+    REQUIRE(renamed.size() == 1);
+    REQUIRE(renamed[0].total.amount == 80);
+  }
 }
@@ -1,12 +1,14 @@
 #include "../Source/Model/RoastyModel.hpp"
 #include "../Source/Serialisation.hpp"
+#include "../Source/Server/RoastyServerException.hpp"
 #include <catch2/catch.hpp>
+#include <sstream>
 
 using json = nlohmann::json;
 
 TEST_CASE("Serialisation") {
   SECTION("Can serialise bean blend") {
-    Ingredient b{*(new Bean{"Java"}), 500};
+    Ingredient b{Bean{"Java"}, 500};
     auto j = ingredientToJson(b);
 
     REQUIRE(j["amount"].get<int>() == 500);
@@ -28,8 +30,7 @@ TEST_CASE("Serialisation") {
   }
 
   SECTION("Can serialise event") {
-    auto* value = new EventValue(500);
-    Event e{"measurement", 100, value};
+    Event e{"measurement", 100, 500};
     auto j = eventToJson(e);
 
     REQUIRE(j["timestamp"].get<int>() == 100);
@@ -55,9 +56,9 @@ TEST_CASE("Serialisation") {
 
   SECTION("Can serialise roast") {
     Roast r{1, 100};
-    r.addEvent(*(new Event{"measurement", 4}));
-    auto* javaBean = new Bean{"Java"};
-    r.addIngredient(*(new Ingredient{*javaBean, 600}));
+    r.addEvent(Event{"measurement", 4});
+    Bean javaBean{"Java"};
+    r.addIngredient(Ingredient{javaBean, 600});
     auto roast = roastToJson(r);
 
     REQUIRE(roast["id"].get<int>() == 1);
@@ -94,3 +95,202 @@ TEST_CASE("Serialisation") {
     REQUIRE(r.getIngredient(0).getAmount() == 600);
   }
 }
+
+TEST_CASE("Streaming writer matches the json tree") {
+  Roast r{3, 2352351221};
+  r.addEvent(Event{"measurement", 12512523, -750});
+  r.addEvent(Event{"first \"crack\"\n\t\x01", 12512600});
+  r.addIngredient(Ingredient{Bean{"java \\ sumatra"}, 600});
+
+  std::string out;
+  writeRoastJson(out, r);
+  REQUIRE(out == roastToJson(r).dump());
+
+  Roast empty{4, 0};
+  out.clear();
+  writeRoastsJson(out, {r, empty});
+  REQUIRE(out == json{roastToJson(r), roastToJson(empty)}.dump());
+
+  out.clear();
+  writeRoastsJson(out, {});
+  REQUIRE(out == json{}.dump());
+}
+
+TEST_CASE("Parsing without a json tree") {
+  SECTION("Roasts are built straight from the text") {
+    auto r = parseRoast(R"({"id": 3, "beginTimestamp": 2352351221, "notes": {"a": [1, 2]},
+                            "beans": [{"name": "java", "amount": 600}],
+                            "events": [{"type": "measurement", "value": 750, "timestamp": 1},
+                                       {"id": 2, "type": "first crack", "timestamp": 2}]})");
+
+    REQUIRE(r.getId() == 3);
+    REQUIRE(r.getTimestamp() == 2352351221);
+    REQUIRE(r.getEventCount() == 2);
+    REQUIRE(r.getEvent(0).getValue()->getValue() == 750);
+    REQUIRE_FALSE(r.getEvent(1).hasValue());
+    REQUIRE(r.getIngredient(0).getBean().getName() == "java");
+
+    std::string out;
+    writeRoastJson(out, r);
+    REQUIRE(parseRoast(out).getEvent(1).getType() == "first crack");
+  }
+
+  SECTION("Events and ingredients are parsed on their own") {
+    auto e = parseEvent(R"({"type": "measurement", "timestamp": 5, "value": null})");
+    REQUIRE(e.getTimestamp() == 5);
+    REQUIRE_FALSE(e.hasValue());
+
+    auto i = parseIngredient(R"({"name": "Kenya", "amount": 12})");
+    REQUIRE(i.getAmount() == 12);
+  }
+
+  SECTION("Lists of roasts are parsed from a stream") {
+    std::istringstream input{R"([{"id": 1, "beginTimestamp": 10}, {"id": 2, "beginTimestamp": 20}])"};
+    auto roasts = parseRoasts(input);
+    REQUIRE(roasts.size() == 2);
+    REQUIRE(roasts[1].getTimestamp() == 20);
+  }
+
+  SECTION("Malformed and incomplete documents are client errors") {
+    auto status = [](auto parse) {
+      try {
+        parse();
+      } catch(RoastyServerException& e) {
+        return e.status;
+      }
+      return 0;
+    };
+
+    REQUIRE(status([] { parseRoast(R"({"id": 1, "beginTimestamp": )"); }) == 400);
+    REQUIRE(status([] { parseRoast(R"({"id": 1})"); }) == 400);
+    REQUIRE(status([] { parseRoast(R"({"id": "1", "beginTimestamp": 2})"); }) == 400);
+    REQUIRE(status([] { parseRoast(R"([])"); }) == 400);
+    REQUIRE(status([] { parseRoast(R"({"id": true, "beginTimestamp": 2})"); }) == 400);
+    REQUIRE(status([] { parseRoast(R"({"id": 1, "beginTimestamp": false})"); }) == 400);
+    REQUIRE(status([] { parseEvent(R"({"type": "drop", "timestamp": true})"); }) == 400);
+    REQUIRE(parseEvent(R"({"type": "drop", "timestamp": 5, "value": true})").hasValue());
+    REQUIRE(status([] { parseEvent(R"({"type": 5, "timestamp": 5})"); }) == 400);
+    REQUIRE(status([] { parseIngredient(R"({"name": "Java"})"); }) == 400);
+  }
+}
+
+TEST_CASE("Binary wire formats") {
+  REQUIRE(wireFormatOf("application/json") == WireFormat::Json);
+  REQUIRE(wireFormatOf("*/*") == WireFormat::Json);
+  REQUIRE(wireFormatOf("application/msgpack, application/cbor;q=0.5") == WireFormat::MessagePack);
+  REQUIRE(wireFormatOf("application/cbor") == WireFormat::Cbor);
+
+  Roast r{3, 2352351221};
+  r.addEvent(Event{"measurement", 1, 750});
+  r.addIngredient(Ingredient{Bean{"java"}, 600});
+
+  for(auto format : {WireFormat::Cbor, WireFormat::MessagePack}) {
+    std::string body;
+    writeRoast(body, r, format);
+    auto parsed = parseRoast(body, format);
+
+    REQUIRE(parsed.getTimestamp() == 2352351221);
+    REQUIRE(parsed.getEvent(0).getValue()->getValue() == 750);
+    REQUIRE(parsed.getIngredient(0).getAmount() == 600);
+
+    body.clear();
+    writeEvent(body, r.getEvent(0), format);
+    REQUIRE(parseEvent(body, format).getTimestamp() == 1);
+  }
+
+  REQUIRE_THROWS_AS(parseRoast("\xff\x00", WireFormat::Cbor), RoastyServerException);
+}
+
+TEST_CASE("Listings encoded piece by piece match the json tree") {
+  for(auto count : {0, 3, 20, 300}) {
+    std::vector<Roast> roasts;
+    json tree;
+    for(auto i = 0; i < count; i++) {
+      roasts.emplace_back(i, i * 10);
+      roasts.back().addEvent(Event{"measurement", i, i});
+      tree.push_back(roastToJson(roasts.back()));
+    }
+
+    std::string out;
+    writeRoasts(out, roasts, WireFormat::Json);
+    REQUIRE(out == tree.dump());
+
+    auto cbor = json::to_cbor(tree);
+    out.clear();
+    writeRoasts(out, roasts, WireFormat::Cbor);
+    REQUIRE(out == std::string(cbor.begin(), cbor.end()));
+
+    auto msgpack = json::to_msgpack(tree);
+    out.clear();
+    writeRoasts(out, roasts, WireFormat::MessagePack);
+    REQUIRE(out == std::string(msgpack.begin(), msgpack.end()));
+  }
+}
+
+TEST_CASE("Responses limited to selected fields") {
+  Roast r{3, 2352351221};
+  r.addEvent(Event{"measurement", 1, 750});
+  r.addEvent(Event{"first crack", 2});
+  r.addIngredient(Ingredient{Bean{"java"}, 600});
+
+  SECTION("Only the selected fields are written") {
+    std::string out;
+    writeRoastJson(out, r, RoastFields::parse("id,beginTimestamp"));
+    REQUIRE(out == R"({"beginTimestamp":2352351221,"id":3})");
+
+    out.clear();
+    writeRoastJson(out, r, RoastFields::parse("events.type"));
+    REQUIRE(out == R"({"events":[{"type":"measurement"},{"type":"first crack"}]})");
+
+    out.clear();
+    writeRoastJson(out, r, RoastFields::parse("beans,id"));
+    REQUIRE(out == R"({"beans":[{"amount":600,"name":"java"}],"id":3})");
+  }
+
+  SECTION("Every combination matches the json tree") {
+    for(auto selected = 1U; selected <= RoastFields::all; selected++) {
+      RoastFields fields{selected};
+      std::string out;
+      writeRoastJson(out, r, fields);
+      REQUIRE(out == roastToJson(r, fields).dump());
+    }
+  }
+
+  SECTION("Unknown fields are rejected") {
+    REQUIRE_THROWS_AS(RoastFields::parse("id,colour"), RoastyServerException);
+    REQUIRE_THROWS_AS(RoastFields::parse(""), RoastyServerException);
+  }
+}
+
+TEST_CASE("Batches of events") {
+  auto events = parseEvents(R"([{"type": "measurement", "timestamp": 1, "value": 180},
+                                {"type": "first crack", "timestamp": 2}])");
+  REQUIRE(events.size() == 2);
+  REQUIRE(events[0].getValue()->getValue() == 180);
+  REQUIRE(events[1].getType() == "first crack");
+
+  auto lines = parseEventLines("{\"type\": \"measurement\", \"timestamp\": 1, \"value\": 180}\r\n"
+                               "\n"
+                               "{\"type\": \"first crack\", \"timestamp\": 2}\n");
+  REQUIRE(lines.size() == 2);
+  REQUIRE(lines[1].getTimestamp() == 2);
+
+  REQUIRE(parseEvents("[]").empty());
+  REQUIRE_THROWS_AS(parseEvents(R"({"type": "measurement", "timestamp": 1})"),
+                    RoastyServerException);
+  REQUIRE_THROWS_AS(parseEventLines("{\"type\": \"measurement\"}"), RoastyServerException);
+}
+
+TEST_CASE("Aggregated windows carry the aggregates selected") {
+  std::vector<EventBucket> buckets{{0, 2, 100, 110, 105}, {5000, 1, 120, 120, 120}};
+
+  std::string out;
+  writeEventBuckets(out, buckets, EventAggregate::Min | EventAggregate::Avg, WireFormat::Json);
+  REQUIRE(out == R"([{"avg":105.0,"min":100,"start":0},{"avg":120.0,"min":120,"start":5000}])");
+
+  out.clear();
+  writeEventBuckets(out, buckets, EventAggregate::Count, WireFormat::Cbor);
+  auto decoded = json::from_cbor(out);
+  REQUIRE(decoded[1]["count"] == 1);
+  REQUIRE_FALSE(decoded[1].contains("max"));
+}